@@ -1,6 +1,153 @@
 #include <solution.h>
+#include <fs_malloc.h>
+#include <fs_string.h>
+
+#include <sys/types.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+/*
+   Buffers reused for every process, so that a scan does not allocate
+   once the buffers have grown to fit the largest process.
+ */
+struct scan
+{
+	struct fs_strbuf path;
+	struct fs_strbuf exe;
+	struct fs_strbuf args;
+	struct fs_strbuf env;
+
+	char **argv;
+	size_t argv_cap;
+	char **envp;
+	size_t envp_cap;
+};
+
+static bool parse_pid(const char *name, pid_t *pid)
+{
+	pid_t x = 0;
+
+	if (*name == '\0')
+		return false;
+	for (; *name; ++name) {
+		if (*name < '0' || *name > '9')
+			return false;
+		x = x * 10 + (*name - '0');
+	}
+	*pid = x;
+	return true;
+}
+
+/* Replace the content of @b with the content of a file at @path. */
+static int read_file(struct fs_strbuf *b, const char *path)
+{
+	fs_strbuf_clear(b);
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	for (;;) {
+		fs_strbuf_reserve(b, b->len + 4096);
+		ssize_t n = read(fd, b->s + b->len, b->cap - b->len - 1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			int r = -errno;
+			close(fd);
+			return r;
+		}
+		if (n == 0)
+			break;
+		b->len += n;
+	}
+	b->s[b->len] = '\0';
+
+	close(fd);
+	return 0;
+}
+
+/* Split NUL-separated strings in @b into a NULL-terminated array. */
+static char** split_nul(struct fs_strbuf *b, char ***v, size_t *cap)
+{
+	size_t n = 0;
+
+	for (size_t pos = 0; pos < b->len; pos += strlen(b->s + pos) + 1) {
+		if (n + 1 >= *cap) {
+			*cap = *cap ? *cap * 2 : 64;
+			*v = fs_xrealloc(*v, *cap * sizeof((*v)[0]));
+		}
+		(*v)[n++] = b->s + pos;
+	}
+
+	if (*cap == 0) {
+		*cap = 64;
+		*v = fs_xrealloc(*v, *cap * sizeof((*v)[0]));
+	}
+	(*v)[n] = NULL;
+	return *v;
+}
+
+static void scan_process(struct scan *s, pid_t pid)
+{
+	int r;
+
+	fs_strbuf_clear(&s->path);
+	fs_strbuf_appends(&s->path, "/proc/");
+	fs_strbuf_append_uint(&s->path, pid);
+	size_t base = s->path.len;
+
+	fs_strbuf_push_path(&s->path, "exe");
+	if ((r = fs_strbuf_readlinkat(&s->exe, AT_FDCWD, s->path.s)) < 0) {
+		report_error(s->path.s, -r);
+		return;
+	}
+	fs_strbuf_truncate(&s->path, base);
+
+	fs_strbuf_push_path(&s->path, "cmdline");
+	if ((r = read_file(&s->args, s->path.s)) < 0) {
+		report_error(s->path.s, -r);
+		return;
+	}
+	fs_strbuf_truncate(&s->path, base);
+
+	fs_strbuf_push_path(&s->path, "environ");
+	if ((r = read_file(&s->env, s->path.s)) < 0) {
+		report_error(s->path.s, -r);
+		return;
+	}
+
+	report_process(pid, s->exe.s,
+		       split_nul(&s->args, &s->argv, &s->argv_cap),
+		       split_nul(&s->env, &s->envp, &s->envp_cap));
+}
 
 void ps(void)
 {
-	/* implement me */
+	DIR *proc = opendir("/proc");
+	if (proc == NULL) {
+		report_error("/proc", errno);
+		return;
+	}
+
+	struct scan s = {0};
+	struct dirent *de;
+	pid_t pid;
+
+	while ((de = readdir(proc)) != NULL) {
+		if (parse_pid(de->d_name, &pid))
+			scan_process(&s, pid);
+	}
+	closedir(proc);
+
+	fs_xfree(s.envp);
+	fs_xfree(s.argv);
+	fs_strbuf_free(&s.env);
+	fs_strbuf_free(&s.args);
+	fs_strbuf_free(&s.exe);
+	fs_strbuf_free(&s.path);
 }
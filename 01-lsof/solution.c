@@ -1,6 +1,80 @@
 #include <solution.h>
+#include <fs_string.h>
+
+#include <sys/types.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+
+static bool is_number(const char *name)
+{
+	if (*name == '\0')
+		return false;
+	for (; *name; ++name) {
+		if (*name < '0' || *name > '9')
+			return false;
+	}
+	return true;
+}
+
+/*
+   Report files open by a process whose directory in /proc is @path.
+   Both @path and @target are scratch buffers reused across processes.
+ */
+static void scan_process(struct fs_strbuf *path, struct fs_strbuf *target)
+{
+	fs_strbuf_push_path(path, "fd");
+
+	DIR *dir = opendir(path->s);
+	if (dir == NULL) {
+		report_error(path->s, errno);
+		return;
+	}
+
+	struct dirent *de;
+	while ((de = readdir(dir)) != NULL) {
+		if (!is_number(de->d_name))
+			continue;
+
+		/* Resolve the link relative to the open directory rather
+		   than by its full path. */
+		int r = fs_strbuf_readlinkat(target, dirfd(dir), de->d_name);
+		if (r < 0) {
+			size_t len = fs_strbuf_push_path(path, de->d_name);
+			report_error(path->s, -r);
+			fs_strbuf_truncate(path, len);
+			continue;
+		}
+		report_file(target->s);
+	}
+	closedir(dir);
+}
 
 void lsof(void)
 {
-	/* implement me */
+	DIR *proc = opendir("/proc");
+	if (proc == NULL) {
+		report_error("/proc", errno);
+		return;
+	}
+
+	struct fs_strbuf path = FS_STRBUF_INIT;
+	struct fs_strbuf target = FS_STRBUF_INIT;
+	struct dirent *de;
+
+	while ((de = readdir(proc)) != NULL) {
+		if (!is_number(de->d_name))
+			continue;
+
+		fs_strbuf_clear(&path);
+		fs_strbuf_appends(&path, "/proc/");
+		fs_strbuf_appends(&path, de->d_name);
+		scan_process(&path, &target);
+	}
+	closedir(proc);
+
+	fs_strbuf_free(&target);
+	fs_strbuf_free(&path);
 }
@@ -0,0 +1,34 @@
+#include <hello.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+size_t hello_content(char *buf, size_t size, pid_t pid)
+{
+	int n = snprintf(buf, size, "hello, %d\n", (int)pid);
+	return (size_t)n < size ? (size_t)n : size - 1;
+}
+
+void hello_root_stat(struct stat *st)
+{
+	memset(st, 0, sizeof(*st));
+	st->st_ino = 1;
+	st->st_mode = S_IFDIR | 0775;
+	st->st_nlink = 2;
+	st->st_uid = getuid();
+	st->st_gid = getgid();
+}
+
+void hello_file_stat(struct stat *st, pid_t pid)
+{
+	char buf[32];
+
+	memset(st, 0, sizeof(*st));
+	st->st_ino = 2;
+	st->st_mode = S_IFREG | 0400;
+	st->st_nlink = 1;
+	st->st_uid = getuid();
+	st->st_gid = getgid();
+	st->st_size = hello_content(buf, sizeof(buf), pid);
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stddef.h>
+
+/* The content of the filesystem, shared by the high- and low-level variants. */
+
+#define HELLO_NAME "hello"
+
+/* Fill @buf with the content of "hello" as read by a process @pid,
+   and return its length. */
+size_t hello_content(char *buf, size_t size, pid_t pid);
+
+void hello_root_stat(struct stat *st);
+void hello_file_stat(struct stat *st, pid_t pid);
@@ -0,0 +1,316 @@
+#include <solution.h>
+#include <hello.h>
+
+#include <fuse_lowlevel.h>
+
+#include <string.h>
+#include <errno.h>
+
+#define HELLO_INO 2
+
+static int ino_stat(fuse_req_t req, fuse_ino_t ino, struct stat *st)
+{
+	if (ino == FUSE_ROOT_ID)
+		hello_root_stat(st);
+	else if (ino == HELLO_INO)
+		hello_file_stat(st, fuse_req_ctx(req)->pid);
+	else
+		return -ENOENT;
+	return 0;
+}
+
+/* Reply with at most @size bytes of @buf starting at @off. */
+static void reply_buf_limited(fuse_req_t req, const char *buf, size_t len, off_t off, size_t size)
+{
+	if (off < 0 || (size_t)off >= len)
+		fuse_reply_buf(req, NULL, 0);
+	else
+		fuse_reply_buf(req, buf + off, len - off < size ? len - off : size);
+}
+
+static void hello_ll_lookup(fuse_req_t req, fuse_ino_t parent, const char *name)
+{
+	/* Zero timeouts, since the content of "hello" depends on the reader. */
+	struct fuse_entry_param e = {.ino = HELLO_INO};
+
+	if (parent != FUSE_ROOT_ID || strcmp(name, HELLO_NAME) != 0) {
+		fuse_reply_err(req, ENOENT);
+		return;
+	}
+
+	ino_stat(req, HELLO_INO, &e.attr);
+	fuse_reply_entry(req, &e);
+}
+
+static void hello_ll_getattr(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+	(void) fi;
+
+	struct stat st;
+	int r = ino_stat(req, ino, &st);
+	if (r < 0)
+		fuse_reply_err(req, -r);
+	else
+		fuse_reply_attr(req, &st, 0);
+}
+
+static void hello_ll_opendir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+	if (ino != FUSE_ROOT_ID)
+		fuse_reply_err(req, ENOTDIR);
+	else
+		fuse_reply_open(req, fi);
+}
+
+static void hello_ll_readdir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+			     struct fuse_file_info *fi)
+{
+	(void) fi;
+
+	static const struct
+	{
+		const char *name;
+		fuse_ino_t ino;
+	} entries[] = {
+		{".", FUSE_ROOT_ID},
+		{"..", FUSE_ROOT_ID},
+		{HELLO_NAME, HELLO_INO},
+	};
+	char buf[256];
+	size_t len = 0;
+
+	if (ino != FUSE_ROOT_ID) {
+		fuse_reply_err(req, ENOTDIR);
+		return;
+	}
+	if (size > sizeof(buf))
+		size = sizeof(buf);
+
+	/* The offset of an entry is the index of the entry that follows it. */
+	for (size_t i = off; off >= 0 && i < sizeof(entries) / sizeof(entries[0]); ++i) {
+		struct stat st = {.st_ino = entries[i].ino};
+		st.st_mode = entries[i].ino == FUSE_ROOT_ID ? S_IFDIR : S_IFREG;
+
+		size_t n = fuse_add_direntry(req, buf + len, size - len, entries[i].name, &st, i + 1);
+		if (n > size - len)
+			break;
+		len += n;
+	}
+	fuse_reply_buf(req, buf, len);
+}
+
+static void hello_ll_releasedir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+	(void) ino;
+	(void) fi;
+
+	fuse_reply_err(req, 0);
+}
+
+static void hello_ll_open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+	if (ino == FUSE_ROOT_ID)
+		fuse_reply_err(req, EISDIR);
+	else if (ino != HELLO_INO)
+		fuse_reply_err(req, ENOENT);
+	else if ((fi->flags & O_ACCMODE) != O_RDONLY)
+		fuse_reply_err(req, EROFS);
+	else {
+		fi->direct_io = 1;
+		fuse_reply_open(req, fi);
+	}
+}
+
+static void hello_ll_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+			  struct fuse_file_info *fi)
+{
+	(void) ino;
+	(void) fi;
+
+	char content[32];
+	size_t len = hello_content(content, sizeof(content), fuse_req_ctx(req)->pid);
+	reply_buf_limited(req, content, len, off, size);
+}
+
+static void hello_ll_release(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+	(void) ino;
+	(void) fi;
+
+	fuse_reply_err(req, 0);
+}
+
+/* The file system is read-only, every modification fails with EROFS. */
+
+static void hello_ll_setattr(fuse_req_t req, fuse_ino_t ino, struct stat *attr, int to_set,
+			     struct fuse_file_info *fi)
+{
+	(void) ino;
+	(void) attr;
+	(void) to_set;
+	(void) fi;
+
+	fuse_reply_err(req, EROFS);
+}
+
+static void hello_ll_mknod(fuse_req_t req, fuse_ino_t parent, const char *name,
+			   mode_t mode, dev_t rdev)
+{
+	(void) parent;
+	(void) name;
+	(void) mode;
+	(void) rdev;
+
+	fuse_reply_err(req, EROFS);
+}
+
+static void hello_ll_mkdir(fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode)
+{
+	(void) parent;
+	(void) name;
+	(void) mode;
+
+	fuse_reply_err(req, EROFS);
+}
+
+static void hello_ll_unlink(fuse_req_t req, fuse_ino_t parent, const char *name)
+{
+	(void) parent;
+	(void) name;
+
+	fuse_reply_err(req, EROFS);
+}
+
+static void hello_ll_rmdir(fuse_req_t req, fuse_ino_t parent, const char *name)
+{
+	(void) parent;
+	(void) name;
+
+	fuse_reply_err(req, EROFS);
+}
+
+static void hello_ll_symlink(fuse_req_t req, const char *link, fuse_ino_t parent,
+			     const char *name)
+{
+	(void) link;
+	(void) parent;
+	(void) name;
+
+	fuse_reply_err(req, EROFS);
+}
+
+static void hello_ll_rename(fuse_req_t req, fuse_ino_t parent, const char *name,
+			    fuse_ino_t newparent, const char *newname, unsigned int flags)
+{
+	(void) parent;
+	(void) name;
+	(void) newparent;
+	(void) newname;
+	(void) flags;
+
+	fuse_reply_err(req, EROFS);
+}
+
+static void hello_ll_link(fuse_req_t req, fuse_ino_t ino, fuse_ino_t newparent,
+			  const char *newname)
+{
+	(void) ino;
+	(void) newparent;
+	(void) newname;
+
+	fuse_reply_err(req, EROFS);
+}
+
+static void hello_ll_write(fuse_req_t req, fuse_ino_t ino, const char *buf, size_t size,
+			   off_t off, struct fuse_file_info *fi)
+{
+	(void) ino;
+	(void) buf;
+	(void) size;
+	(void) off;
+	(void) fi;
+
+	fuse_reply_err(req, EROFS);
+}
+
+static void hello_ll_setxattr(fuse_req_t req, fuse_ino_t ino, const char *name,
+			      const char *value, size_t size, int flags)
+{
+	(void) ino;
+	(void) name;
+	(void) value;
+	(void) size;
+	(void) flags;
+
+	fuse_reply_err(req, EROFS);
+}
+
+static void hello_ll_removexattr(fuse_req_t req, fuse_ino_t ino, const char *name)
+{
+	(void) ino;
+	(void) name;
+
+	fuse_reply_err(req, EROFS);
+}
+
+static void hello_ll_create(fuse_req_t req, fuse_ino_t parent, const char *name,
+			    mode_t mode, struct fuse_file_info *fi)
+{
+	(void) parent;
+	(void) name;
+	(void) mode;
+	(void) fi;
+
+	fuse_reply_err(req, EROFS);
+}
+
+static const struct fuse_lowlevel_ops hello_ll_ops = {
+	.lookup = hello_ll_lookup,
+	.getattr = hello_ll_getattr,
+	.opendir = hello_ll_opendir,
+	.readdir = hello_ll_readdir,
+	.releasedir = hello_ll_releasedir,
+	.open = hello_ll_open,
+	.read = hello_ll_read,
+	.release = hello_ll_release,
+	.setattr = hello_ll_setattr,
+	.mknod = hello_ll_mknod,
+	.mkdir = hello_ll_mkdir,
+	.unlink = hello_ll_unlink,
+	.rmdir = hello_ll_rmdir,
+	.symlink = hello_ll_symlink,
+	.rename = hello_ll_rename,
+	.link = hello_ll_link,
+	.write = hello_ll_write,
+	.setxattr = hello_ll_setxattr,
+	.removexattr = hello_ll_removexattr,
+	.create = hello_ll_create,
+};
+
+int helloworld_ll(const char *mntp)
+{
+	char *argv[] = {"exercise", NULL};
+	struct fuse_args args = FUSE_ARGS_INIT(1, argv);
+	struct fuse_session *se;
+	int r = 1;
+
+	se = fuse_session_new(&args, &hello_ll_ops, sizeof(hello_ll_ops), NULL);
+	if (!se)
+		goto out_args;
+	if (fuse_set_signal_handlers(se) != 0)
+		goto out_session;
+	if (fuse_session_mount(se, mntp) != 0)
+		goto out_signals;
+
+	/* Every worker thread gets its own /dev/fuse channel. */
+	r = fuse_session_loop_mt(se, 1);
+
+	fuse_session_unmount(se);
+out_signals:
+	fuse_remove_signal_handlers(se);
+out_session:
+	fuse_session_destroy(se);
+out_args:
+	fuse_opt_free_args(&args);
+	return r;
+}
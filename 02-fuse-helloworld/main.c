@@ -1,11 +1,16 @@
 #include <solution.h>
 
 #include <stdio.h>
+#include <string.h>
 
 int main(int argc, char **argv)
 {
+	if (argc == 3 && strcmp(argv[1], "-l") == 0)
+		return helloworld_ll(argv[2]);
+
 	if (argc != 2) {
-		fprintf(stderr, "use: %s <mount-point>\n", argv[0]);
+		fprintf(stderr, "use: %s [-l] <mount-point>\n", argv[0]);
+		fprintf(stderr, "  -l  use the low-level FUSE API\n");
 		return 1;
 	}
 
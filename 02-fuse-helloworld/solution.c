@@ -1,9 +1,239 @@
 #include <solution.h>
+#include <hello.h>
 
 #include <fuse.h>
 
+#include <string.h>
+#include <errno.h>
+
+#define HELLO_PATH "/" HELLO_NAME
+
+static void* hellofs_init(struct fuse_conn_info *conn, struct fuse_config *cfg)
+{
+	(void) conn;
+
+	/* The content of "hello" depends on the reader, nothing may be cached. */
+	cfg->entry_timeout = 0;
+	cfg->negative_timeout = 0;
+	cfg->attr_timeout = 0;
+	return NULL;
+}
+
+static int hellofs_getattr(const char *path, struct stat *st, struct fuse_file_info *fi)
+{
+	(void) fi;
+
+	if (strcmp(path, "/") == 0)
+		hello_root_stat(st);
+	else if (strcmp(path, HELLO_PATH) == 0)
+		hello_file_stat(st, fuse_get_context()->pid);
+	else
+		return -ENOENT;
+	return 0;
+}
+
+static int hellofs_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t off,
+			   struct fuse_file_info *fi, enum fuse_readdir_flags flags)
+{
+	(void) off;
+	(void) fi;
+	(void) flags;
+
+	if (strcmp(path, "/") != 0)
+		return -ENOTDIR;
+
+	filler(buf, ".", NULL, 0, 0);
+	filler(buf, "..", NULL, 0, 0);
+	filler(buf, HELLO_NAME, NULL, 0, 0);
+	return 0;
+}
+
+static int hellofs_open(const char *path, struct fuse_file_info *fi)
+{
+	if (strcmp(path, HELLO_PATH) != 0)
+		return strcmp(path, "/") == 0 ? -EISDIR : -ENOENT;
+	if ((fi->flags & O_ACCMODE) != O_RDONLY)
+		return -EROFS;
+
+	fi->direct_io = 1;
+	return 0;
+}
+
+static int hellofs_read(const char *path, char *buf, size_t size, off_t off,
+			struct fuse_file_info *fi)
+{
+	(void) path;
+	(void) fi;
+
+	char content[32];
+	size_t len = hello_content(content, sizeof(content), fuse_get_context()->pid);
+
+	if (off < 0 || (size_t)off >= len)
+		return 0;
+	if (size > len - off)
+		size = len - off;
+	memcpy(buf, content + off, size);
+	return size;
+}
+
+/* The file system is read-only, every modification fails with EROFS. */
+
+static int hellofs_mknod(const char *path, mode_t mode, dev_t dev)
+{
+	(void) path;
+	(void) mode;
+	(void) dev;
+
+	return -EROFS;
+}
+
+static int hellofs_mkdir(const char *path, mode_t mode)
+{
+	(void) path;
+	(void) mode;
+
+	return -EROFS;
+}
+
+static int hellofs_unlink(const char *path)
+{
+	(void) path;
+
+	return -EROFS;
+}
+
+static int hellofs_rmdir(const char *path)
+{
+	(void) path;
+
+	return -EROFS;
+}
+
+static int hellofs_symlink(const char *target, const char *path)
+{
+	(void) target;
+	(void) path;
+
+	return -EROFS;
+}
+
+static int hellofs_rename(const char *from, const char *to, unsigned int flags)
+{
+	(void) from;
+	(void) to;
+	(void) flags;
+
+	return -EROFS;
+}
+
+static int hellofs_link(const char *from, const char *to)
+{
+	(void) from;
+	(void) to;
+
+	return -EROFS;
+}
+
+static int hellofs_chmod(const char *path, mode_t mode, struct fuse_file_info *fi)
+{
+	(void) path;
+	(void) mode;
+	(void) fi;
+
+	return -EROFS;
+}
+
+static int hellofs_chown(const char *path, uid_t uid, gid_t gid, struct fuse_file_info *fi)
+{
+	(void) path;
+	(void) uid;
+	(void) gid;
+	(void) fi;
+
+	return -EROFS;
+}
+
+static int hellofs_truncate(const char *path, off_t size, struct fuse_file_info *fi)
+{
+	(void) path;
+	(void) size;
+	(void) fi;
+
+	return -EROFS;
+}
+
+static int hellofs_write(const char *path, const char *buf, size_t size, off_t off,
+			 struct fuse_file_info *fi)
+{
+	(void) path;
+	(void) buf;
+	(void) size;
+	(void) off;
+	(void) fi;
+
+	return -EROFS;
+}
+
+static int hellofs_setxattr(const char *path, const char *name, const char *value,
+			    size_t size, int flags)
+{
+	(void) path;
+	(void) name;
+	(void) value;
+	(void) size;
+	(void) flags;
+
+	return -EROFS;
+}
+
+static int hellofs_removexattr(const char *path, const char *name)
+{
+	(void) path;
+	(void) name;
+
+	return -EROFS;
+}
+
+static int hellofs_create(const char *path, mode_t mode, struct fuse_file_info *fi)
+{
+	(void) path;
+	(void) mode;
+	(void) fi;
+
+	return -EROFS;
+}
+
+static int hellofs_utimens(const char *path, const struct timespec tv[2],
+			   struct fuse_file_info *fi)
+{
+	(void) path;
+	(void) tv;
+	(void) fi;
+
+	return -EROFS;
+}
+
 static const struct fuse_operations hellofs_ops = {
-	/* implement me */
+	.init = hellofs_init,
+	.getattr = hellofs_getattr,
+	.readdir = hellofs_readdir,
+	.open = hellofs_open,
+	.read = hellofs_read,
+	.mknod = hellofs_mknod,
+	.mkdir = hellofs_mkdir,
+	.unlink = hellofs_unlink,
+	.rmdir = hellofs_rmdir,
+	.symlink = hellofs_symlink,
+	.rename = hellofs_rename,
+	.link = hellofs_link,
+	.chmod = hellofs_chmod,
+	.chown = hellofs_chown,
+	.truncate = hellofs_truncate,
+	.write = hellofs_write,
+	.setxattr = hellofs_setxattr,
+	.removexattr = hellofs_removexattr,
+	.create = hellofs_create,
+	.utimens = hellofs_utimens,
 };
 
 int helloworld(const char *mntp)
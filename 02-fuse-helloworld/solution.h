@@ -19,3 +19,14 @@
    Any attempt write to the FS must report EROFS.
 */
 int helloworld(const char *mntp);
+
+/**
+   Same as helloworld(), but implemented with the low-level FUSE API.
+   Requests address inodes by number instead of by path, and are served
+   by a multithreaded session loop with a /dev/fuse clone per thread.
+
+   Both variants disable attribute and entry caching in the kernel, so
+   that every stat(), open() and read() reaches the daemon, and their
+   costs may be compared with 16-fuse-bench.
+*/
+int helloworld_ll(const char *mntp);
@@ -0,0 +1,8 @@
+#include <solution.h>
+
+#include <stdio.h>
+
+void report_file(int inode_nr, char type, const char *name)
+{
+	printf("%i %c %s\n", inode_nr, type, name);
+}
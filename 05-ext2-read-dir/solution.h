@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stddef.h>
+
 /**
    Implement this function to parse the content of an inode @inode_nr
    as an ext2 directory. The function must call report_file() for each
@@ -20,3 +22,26 @@ int dump_dir(int img, int inode_nr);
    @name is the name (NULL-terminated) of the entry.
  */
 void report_file(int inode_nr, char type, const char *name);
+
+/**
+   A directory entry as delivered by dump_dir_batch(). @name is
+   NULL-terminated and is only valid during the callback.
+ */
+struct dir_entry
+{
+	int inode_nr;
+	char type;
+	const char *name;
+};
+
+/**
+   Same as dump_dir(), but instead of calling report_file() for each
+   entry call @report once per directory block with an array of @n
+   entries found in that block, in the on-disk order.
+
+   Directory blocks are fetched in windows. A window that maps to a few
+   runs of blocks on the disk is read with a single preadv().
+*/
+int dump_dir_batch(int img, int inode_nr,
+		   void (*report)(const struct dir_entry *entries, size_t n, void *arg),
+		   void *arg);
@@ -1,11 +1,660 @@
 #include <solution.h>
+#include <fs_malloc.h>
+#include <fs_string.h>
 
-int dump_file(int img, const char *path, int out)
+#include <ntfs-3g/types.h>
+#include <ntfs-3g/volume.h>
+#include <ntfs-3g/inode.h>
+#include <ntfs-3g/attrib.h>
+#include <ntfs-3g/runlist.h>
+#include <ntfs-3g/unistr.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+/* The size of a single read when data is copied through user space. */
+#define COPY_CHUNK (1 << 20)
+
+/*
+   A sink for file data. Data is appended at the current offset of @out,
+   and holes are accumulated in @hole until more data arrives, so that
+   runs of sparse clusters become a single lseek().
+ */
+struct copier
+{
+	int img;
+	int out;
+
+	bool can_copy_range;
+	bool can_seek;
+
+	off_t hole;
+	char *buf;
+};
+
+static void copier_init(struct copier *c, int img, int out)
+{
+	c->img = img;
+	c->out = out;
+	c->can_copy_range = true;
+	c->can_seek = true;
+	c->hole = 0;
+	c->buf = fs_xmalloc(COPY_CHUNK);
+}
+
+static void copier_free(struct copier *c)
+{
+	fs_xfree(c->buf);
+}
+
+static int write_all(int fd, const char *buf, size_t len)
+{
+	while (len > 0) {
+		ssize_t n = write(fd, buf, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int flush_hole(struct copier *c)
+{
+	if (c->hole == 0)
+		return 0;
+
+	if (c->can_seek) {
+		if (lseek(c->out, c->hole, SEEK_CUR) >= 0) {
+			c->hole = 0;
+			return 0;
+		}
+		if (errno != ESPIPE)
+			return -errno;
+		c->can_seek = false;
+	}
+
+	memset(c->buf, 0, COPY_CHUNK);
+	while (c->hole > 0) {
+		size_t n = c->hole < COPY_CHUNK ? c->hole : COPY_CHUNK;
+		int r = write_all(c->out, c->buf, n);
+		if (r < 0)
+			return r;
+		c->hole -= n;
+	}
+	return 0;
+}
+
+static int copy_hole(struct copier *c, off_t len)
+{
+	c->hole += len;
+	return 0;
+}
+
+static int copy_buf(struct copier *c, const char *buf, size_t len)
+{
+	int r = flush_hole(c);
+	if (r < 0)
+		return r;
+	return write_all(c->out, buf, len);
+}
+
+/* Copy @len bytes at @pos in the image verbatim. */
+static int copy_extent(struct copier *c, off_t pos, size_t len)
+{
+	int r = flush_hole(c);
+	if (r < 0)
+		return r;
+
+	while (len > 0 && c->can_copy_range) {
+		ssize_t n = copy_file_range(c->img, &pos, c->out, NULL, len, 0);
+		if (n > 0) {
+			len -= n;
+			continue;
+		}
+		if (n == 0)
+			return -EIO;
+		if (errno == EINTR)
+			continue;
+		if (errno != EXDEV && errno != EINVAL && errno != ENOSYS &&
+		    errno != EOPNOTSUPP && errno != EBADF)
+			return -errno;
+		c->can_copy_range = false;
+	}
+
+	while (len > 0) {
+		size_t want = len < COPY_CHUNK ? len : COPY_CHUNK;
+		ssize_t n = pread(c->img, c->buf, want, pos);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		if (n == 0)
+			return -EIO;
+		r = write_all(c->out, c->buf, n);
+		if (r < 0)
+			return r;
+		pos += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/* Materialise a trailing hole, if any. */
+static int copier_finish(struct copier *c)
+{
+	if (c->hole == 0 || !c->can_seek)
+		return flush_hole(c);
+
+	off_t end = lseek(c->out, c->hole, SEEK_CUR);
+	if (end < 0 && errno == ESPIPE) {
+		c->can_seek = false;
+		return flush_hole(c);
+	}
+	if (end < 0 || ftruncate(c->out, end) < 0)
+		return -errno;
+	c->hole = 0;
+	return 0;
+}
+
+/*
+   Copy a non-resident, uncompressed and unencrypted attribute by
+   walking its runlist and copying the clusters straight from the image.
+   Sparse runs and the uninitialised tail become holes.
+ */
+static int copy_runlist(ntfs_attr *na, struct copier *c)
+{
+	ntfs_volume *vol = na->ni->vol;
+
+	if (ntfs_attr_map_whole_runlist(na))
+		return -errno;
+
+	s64 size = na->data_size;
+	s64 init = na->initialized_size < size ? na->initialized_size : size;
+	s64 pos = 0;
+
+	for (runlist_element *rl = na->rl; rl->length && pos < size; ++rl) {
+		s64 start = rl->vcn << vol->cluster_size_bits;
+		s64 end = (rl->vcn + rl->length) << vol->cluster_size_bits;
+		int r;
+
+		if (start != pos)
+			return -EIO;
+		if (end > size)
+			end = size;
+
+		if (rl->lcn == LCN_HOLE) {
+			r = copy_hole(c, end - pos);
+			pos = end;
+			if (r < 0)
+				return r;
+			continue;
+		}
+		if (rl->lcn < 0 || rl->lcn + rl->length > vol->nr_clusters)
+			return -EIO;
+
+		s64 data_end = end < init ? end : init;
+		if (pos < data_end) {
+			off_t off = (rl->lcn << vol->cluster_size_bits) + (pos - start);
+			r = copy_extent(c, off, data_end - pos);
+			if (r < 0)
+				return r;
+			pos = data_end;
+		}
+		if (pos < end) {
+			r = copy_hole(c, end - pos);
+			if (r < 0)
+				return r;
+			pos = end;
+		}
+	}
+
+	if (pos < size)
+		return -EIO;
+	return 0;
+}
+
+/* Copy an attribute through libntfs-3g, which deals with
+   resident, compressed and encrypted data. */
+static int copy_attr(ntfs_attr *na, struct copier *c)
+{
+	s64 pos = 0;
+	while (pos < na->data_size) {
+		s64 want = na->data_size - pos;
+		if (want > COPY_CHUNK)
+			want = COPY_CHUNK;
+
+		s64 n = ntfs_attr_pread(na, pos, want, c->buf);
+		if (n < 0)
+			return -errno;
+		if (n == 0)
+			return -EIO;
+
+		int r = copy_buf(c, c->buf, n);
+		if (r < 0)
+			return r;
+		pos += n;
+	}
+	return 0;
+}
+
+/* The number of parsed MFT records kept open by a reader. */
+#define MFT_CACHE_SIZE 256
+#define MFT_CACHE_BUCKETS 512
+
+struct mft_entry
+{
+	u64 mft_no;
+	ntfs_inode *ni;
+
+	struct mft_entry *hnext;
+	struct mft_entry *prev;
+	struct mft_entry *next;
+};
+
+/*
+   A mounted volume and an LRU cache of open inodes keyed by the MFT
+   number. An inode returned by mft_get() stays valid until MFT_CACHE_SIZE
+   other inodes are looked up, which is enough for a path walk that only
+   holds a directory and its child.
+ */
+struct ntfs_reader
+{
+	int img;
+	ntfs_volume *vol;
+
+	struct mft_entry *buckets[MFT_CACHE_BUCKETS];
+	struct mft_entry lru;
+	size_t nr_cached;
+
+	void *index_block;
+	u32 index_block_size;
+};
+
+static void lru_unlink(struct mft_entry *e)
+{
+	e->prev->next = e->next;
+	e->next->prev = e->prev;
+}
+
+static void lru_push(struct ntfs_reader *r, struct mft_entry *e)
+{
+	e->prev = &r->lru;
+	e->next = r->lru.next;
+	r->lru.next->prev = e;
+	r->lru.next = e;
+}
+
+static void mft_evict(struct ntfs_reader *r)
+{
+	struct mft_entry *e = r->lru.prev;
+	struct mft_entry **p = &r->buckets[e->mft_no % MFT_CACHE_BUCKETS];
+	while (*p != e)
+		p = &(*p)->hnext;
+	*p = e->hnext;
+
+	lru_unlink(e);
+	ntfs_inode_close(e->ni);
+	fs_xfree(e);
+	r->nr_cached--;
+}
+
+static int mft_get(struct ntfs_reader *r, u64 mft_no, ntfs_inode **ni)
 {
-	(void) img;
-	(void) path;
-	(void) out;
+	struct mft_entry **bucket = &r->buckets[mft_no % MFT_CACHE_BUCKETS];
+	for (struct mft_entry *e = *bucket; e; e = e->hnext) {
+		if (e->mft_no == mft_no) {
+			lru_unlink(e);
+			lru_push(r, e);
+			*ni = e->ni;
+			return 0;
+		}
+	}
 
-	/* implement me */
+	ntfs_inode *x = ntfs_inode_open(r->vol, mft_no);
+	if (x == NULL)
+		return -errno;
+
+	if (r->nr_cached == MFT_CACHE_SIZE)
+		mft_evict(r);
+
+	struct mft_entry *e = fs_xzalloc(sizeof(*e));
+	e->mft_no = mft_no;
+	e->ni = x;
+	e->hnext = *bucket;
+	*bucket = e;
+	lru_push(r, e);
+	r->nr_cached++;
+
+	*ni = x;
+	return 0;
+}
+
+int ntfs_reader_init(struct ntfs_reader **r, int img)
+{
+	char *dev = fs_xasprintf("/proc/self/fd/%d", img);
+	ntfs_volume *vol = ntfs_mount(dev, NTFS_MNT_RDONLY);
+	fs_xfree(dev);
+	if (vol == NULL)
+		return -errno;
+
+	struct ntfs_reader *x = fs_xzalloc(sizeof(*x));
+	x->img = img;
+	x->vol = vol;
+	x->lru.prev = x->lru.next = &x->lru;
+	*r = x;
 	return 0;
 }
+
+void ntfs_reader_free(struct ntfs_reader *r)
+{
+	if (r == NULL)
+		return;
+
+	while (r->nr_cached)
+		mft_evict(r);
+	ntfs_umount(r->vol, FALSE);
+	fs_xfree(r->index_block);
+	fs_xfree(r);
+}
+
+static bool is_dir(ntfs_inode *ni)
+{
+	return ni->mrec->flags & MFT_RECORD_IS_DIRECTORY;
+}
+
+static ntfschar I30[] = {
+	const_cpu_to_le16('$'), const_cpu_to_le16('I'),
+	const_cpu_to_le16('3'), const_cpu_to_le16('0'),
+};
+
+/* The most entries an index node may hold. */
+#define MAX_NODE_ENTRIES 4096
+
+static int collate(ntfs_volume *vol, INDEX_ENTRY *ie, const ntfschar *uname, u32 uname_len,
+		   IGNORE_CASE_BOOL ic)
+{
+	/* The end marker is greater than any name. */
+	if (ie->ie_flags & INDEX_ENTRY_END)
+		return 1;
+
+	FILE_NAME_ATTR *fn = &ie->key.file_name;
+	return ntfs_names_full_collate(fn->file_name, fn->file_name_length,
+				       uname, uname_len, ic, vol->upcase, vol->upcase_len);
+}
+
+/* Return the first of @nr entries whose name is greater than @uname when
+   compared ignoring case, or not less than it if @or_equal. */
+static size_t bisect(ntfs_volume *vol, INDEX_ENTRY **entries, size_t nr,
+		     const ntfschar *uname, u32 uname_len, bool or_equal)
+{
+	size_t lo = 0, hi = nr - 1;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		int c = collate(vol, entries[mid], uname, uname_len, IGNORE_CASE);
+		if (c < 0 || (c == 0 && !or_equal))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/*
+   Find @uname in a single index node @ih of @len bytes. Entries are
+   sorted by the file name collation: by their upper case forms, and names
+   that differ only in case by their code units. The offsets of entries
+   are gathered first, and the entries equal to @uname ignoring case are
+   bisected.
+
+   Names are case-sensitive, as POSIX names "a" and "A" may both exist.
+   The first Win32 or DOS name that matches only ignoring case is stored
+   in @ci_mref, and @ci_found is set, so that the caller may use it if the
+   name is not found exactly.
+
+   Return values:
+   * 0 if the name was found, @mref is updated,
+   * 1 if the search must continue in a child node at @vcn,
+   * -ENOENT if there is no such name,
+   * -EIO if the node is corrupted.
+ */
+static int search_node(ntfs_volume *vol, INDEX_HEADER *ih, u32 len,
+		       const ntfschar *uname, u32 uname_len,
+		       u64 *mref, u64 *ci_mref, bool *ci_found, VCN *vcn)
+{
+	INDEX_ENTRY *entries[MAX_NODE_ENTRIES];
+	size_t nr = 0;
+
+	u32 off = le32_to_cpu(ih->entries_offset);
+	u32 end = le32_to_cpu(ih->index_length);
+	if (end > len)
+		return -EIO;
+
+	for (;;) {
+		if (off + offsetof(INDEX_ENTRY, key) > end || nr == MAX_NODE_ENTRIES)
+			return -EIO;
+
+		INDEX_ENTRY *ie = (INDEX_ENTRY *)((u8 *)ih + off);
+		u16 ie_len = le16_to_cpu(ie->length);
+		if (ie_len < offsetof(INDEX_ENTRY, key) || off + ie_len > end)
+			return -EIO;
+
+		entries[nr++] = ie;
+		if (ie->ie_flags & INDEX_ENTRY_END)
+			break;
+
+		u16 key_len = le16_to_cpu(ie->key_length);
+		if (key_len < offsetof(FILE_NAME_ATTR, file_name) ||
+		    offsetof(INDEX_ENTRY, key) + key_len > ie_len ||
+		    offsetof(FILE_NAME_ATTR, file_name) +
+		    ie->key.file_name.file_name_length * sizeof(ntfschar) > key_len)
+			return -EIO;
+		off += ie_len;
+	}
+
+	/* Entries [first, last) are equal to @uname ignoring case, and the
+	   exact name sorts before the first of them that is greater. */
+	size_t first = bisect(vol, entries, nr, uname, uname_len, true);
+	size_t last = bisect(vol, entries, nr, uname, uname_len, false);
+	size_t next = last;
+
+	for (size_t i = first; i < last; ++i) {
+		int c = collate(vol, entries[i], uname, uname_len, CASE_SENSITIVE);
+		if (c == 0) {
+			*mref = MREF_LE(entries[i]->indexed_file);
+			return 0;
+		}
+		if (c > 0 && next == last)
+			next = i;
+
+		if (!*ci_found &&
+		    entries[i]->key.file_name.file_name_type != FILE_NAME_POSIX) {
+			*ci_mref = MREF_LE(entries[i]->indexed_file);
+			*ci_found = true;
+		}
+	}
+
+	INDEX_ENTRY *ie = entries[next];
+	if (!(ie->ie_flags & INDEX_ENTRY_NODE))
+		return -ENOENT;
+
+	u16 ie_len = le16_to_cpu(ie->length);
+	if (ie_len < offsetof(INDEX_ENTRY, key) + sizeof(VCN))
+		return -EIO;
+	*vcn = sle64_to_cpu(*(leVCN *)((u8 *)ie + ie_len - sizeof(VCN)));
+	return 1;
+}
+
+/* Look up @uname in the $I30 index B+tree of a directory @dir. */
+static int lookup_name(struct ntfs_reader *r, ntfs_inode *dir,
+		       const ntfschar *uname, u32 uname_len, u64 *mref)
+{
+	ntfs_volume *vol = r->vol;
+	ntfs_attr *ia = NULL;
+	u64 ci_mref = 0;
+	bool ci_found = false;
+	s64 ir_len;
+	VCN vcn;
+	int ret;
+
+	INDEX_ROOT *ir = ntfs_attr_readall(dir, AT_INDEX_ROOT, I30, 4, &ir_len);
+	if (ir == NULL)
+		return -errno;
+
+	if (ir_len < (s64)sizeof(INDEX_ROOT) || ir->type != AT_FILE_NAME ||
+	    ir->collation_rule != COLLATION_FILE_NAME) {
+		ret = -EIO;
+		goto out;
+	}
+
+	ret = search_node(vol, &ir->index, ir_len - offsetof(INDEX_ROOT, index),
+			  uname, uname_len, mref, &ci_mref, &ci_found, &vcn);
+	if (ret <= 0)
+		goto out;
+
+	u32 block_size = le32_to_cpu(ir->index_block_size);
+	u8 vcn_bits = block_size >= vol->cluster_size ? vol->cluster_size_bits : 9;
+	if (block_size < sizeof(INDEX_BLOCK) || (block_size & (block_size - 1))) {
+		ret = -EIO;
+		goto out;
+	}
+
+	ia = ntfs_attr_open(dir, AT_INDEX_ALLOCATION, I30, 4);
+	if (ia == NULL) {
+		ret = -errno;
+		goto out;
+	}
+
+	if (r->index_block_size < block_size) {
+		fs_xfree(r->index_block);
+		r->index_block = fs_xmalloc(block_size);
+		r->index_block_size = block_size;
+	}
+	INDEX_BLOCK *ib = r->index_block;
+
+	/* A B+tree cannot be deeper than the number of its blocks. */
+	for (s64 depth = 0; ret > 0; ++depth) {
+		if (depth > ia->allocated_size / block_size) {
+			ret = -EIO;
+			break;
+		}
+
+		if (ntfs_attr_mst_pread(ia, vcn << vcn_bits, 1, block_size, ib) != 1) {
+			ret = errno ? -errno : -EIO;
+			break;
+		}
+		if (sle64_to_cpu(ib->index_block_vcn) != vcn) {
+			ret = -EIO;
+			break;
+		}
+
+		ret = search_node(vol, &ib->index, block_size - offsetof(INDEX_BLOCK, index),
+				  uname, uname_len, mref, &ci_mref, &ci_found, &vcn);
+	}
+
+out:
+	if (ret == -ENOENT && ci_found) {
+		*mref = ci_mref;
+		ret = 0;
+	}
+	if (ia)
+		ntfs_attr_close(ia);
+	free(ir);
+	return ret;
+}
+
+/* Walk @path from the root directory, and return its inode. */
+static int walk_path(struct ntfs_reader *r, const char *path, ntfs_inode **out)
+{
+	ntfs_inode *ni;
+	int ret = mft_get(r, FILE_root, &ni);
+	if (ret < 0)
+		return ret;
+
+	char *copy = fs_xstrdup(path);
+	char *save = NULL;
+
+	for (char *name = strtok_r(copy, "/", &save); name;
+	     name = strtok_r(NULL, "/", &save)) {
+		if (!is_dir(ni)) {
+			ret = -ENOTDIR;
+			break;
+		}
+
+		ntfschar *uname = NULL;
+		int len = ntfs_mbstoucs(name, &uname);
+		if (len < 0) {
+			ret = -errno;
+			break;
+		}
+
+		u64 mref;
+		ret = lookup_name(r, ni, uname, len, &mref);
+		free(uname);
+		if (ret < 0)
+			break;
+
+		ret = mft_get(r, mref, &ni);
+		if (ret < 0)
+			break;
+	}
+
+	fs_xfree(copy);
+	if (ret < 0)
+		return ret;
+	*out = ni;
+	return 0;
+}
+
+static int dump_inode(ntfs_inode *ni, int img, int out)
+{
+	if (is_dir(ni))
+		return -EISDIR;
+
+	ntfs_attr *na = ntfs_attr_open(ni, AT_DATA, AT_UNNAMED, 0);
+	if (na == NULL)
+		return -errno;
+
+	struct copier c;
+	copier_init(&c, img, out);
+
+	int r;
+	if (NAttrNonResident(na) && !NAttrCompressed(na) && !NAttrEncrypted(na))
+		r = copy_runlist(na, &c);
+	else
+		r = copy_attr(na, &c);
+	if (r == 0)
+		r = copier_finish(&c);
+
+	copier_free(&c);
+	ntfs_attr_close(na);
+	return r;
+}
+
+int ntfs_reader_dump_file(struct ntfs_reader *r, const char *path, int out)
+{
+	ntfs_inode *ni = NULL;
+	int ret = walk_path(r, path, &ni);
+	if (ret < 0)
+		return ret;
+	return dump_inode(ni, r->img, out);
+}
+
+int dump_file(int img, const char *path, int out)
+{
+	struct ntfs_reader *r = NULL;
+	int ret = ntfs_reader_init(&r, img);
+	if (ret < 0)
+		return ret;
+
+	ret = ntfs_reader_dump_file(r, path, out);
+	ntfs_reader_free(r);
+	return ret;
+}
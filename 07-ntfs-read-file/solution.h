@@ -14,3 +14,31 @@
    You may use any API provided by libntfs-3g.
 */
 int dump_file(int img, const char *path, int out);
+
+struct ntfs_reader;
+
+/**
+   Allocate and initialise a reader of an ntfs image open at @img.
+   The reader keeps the volume mounted and caches parsed MFT records
+   of recently visited files and directories, so that a sequence of
+   dump_file()-like calls does not re-read the same records.
+
+   The reader does not take the ownership of @img.
+
+   Return values:
+   * 0 if successful,
+   * a (negative) errno code if the volume could not be mounted.
+ */
+int ntfs_reader_init(struct ntfs_reader **r, int img);
+
+/**
+   Free resources associated with a reader @r.
+
+   Note: ntfs_reader_free(NULL) is a no-op.
+ */
+void ntfs_reader_free(struct ntfs_reader *r);
+
+/**
+   Same as dump_file(), but uses an already initialised reader @r.
+ */
+int ntfs_reader_dump_file(struct ntfs_reader *r, const char *path, int out);
@@ -0,0 +1,227 @@
+#include <bcache.h>
+#include <stats.h>
+#include <fs_malloc.h>
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#define NO_SLOT UINT32_MAX
+
+struct slot
+{
+	uint32_t blk;
+	uint32_t next;
+	bool valid;
+	bool referenced;
+};
+
+struct bcache
+{
+	pthread_mutex_t lock;
+	int fd;
+	uint32_t block_size;
+
+	uint32_t nr_slots;
+	struct slot *slots;
+	char *data;
+	uint32_t hand;
+
+	uint32_t nr_buckets;
+	uint32_t *buckets;
+};
+
+int bcache_init(struct bcache **c, int fd, uint32_t block_size, size_t nr_blocks)
+{
+	if (nr_blocks == 0 || nr_blocks >= NO_SLOT)
+		return -EINVAL;
+
+	struct bcache *x = fs_xzalloc(sizeof(*x));
+	pthread_mutex_init(&x->lock, NULL);
+	x->fd = fd;
+	x->block_size = block_size;
+	x->nr_slots = nr_blocks;
+	x->slots = fs_xzalloc(nr_blocks * sizeof(x->slots[0]));
+	x->data = fs_xmalloc(nr_blocks * block_size);
+
+	x->nr_buckets = 1;
+	while (x->nr_buckets < 2 * nr_blocks)
+		x->nr_buckets *= 2;
+	x->buckets = fs_xmalloc(x->nr_buckets * sizeof(x->buckets[0]));
+	for (uint32_t i = 0; i < x->nr_buckets; ++i)
+		x->buckets[i] = NO_SLOT;
+
+	*c = x;
+	return 0;
+}
+
+void bcache_free(struct bcache *c)
+{
+	if (!c)
+		return;
+
+	pthread_mutex_destroy(&c->lock);
+	fs_xfree(c->buckets);
+	fs_xfree(c->data);
+	fs_xfree(c->slots);
+	fs_xfree(c);
+}
+
+static uint32_t *bucket_of(struct bcache *c, uint32_t blk)
+{
+	return &c->buckets[(blk * 2654435761u) & (c->nr_buckets - 1)];
+}
+
+static uint32_t lookup(struct bcache *c, uint32_t blk)
+{
+	for (uint32_t i = *bucket_of(c, blk); i != NO_SLOT; i = c->slots[i].next) {
+		if (c->slots[i].blk == blk)
+			return i;
+	}
+	return NO_SLOT;
+}
+
+static void unlink_slot(struct bcache *c, uint32_t i)
+{
+	uint32_t *p = bucket_of(c, c->slots[i].blk);
+	while (*p != i)
+		p = &c->slots[*p].next;
+	*p = c->slots[i].next;
+}
+
+/* Pick a slot to reuse, giving referenced slots a second chance. */
+static uint32_t evict(struct bcache *c)
+{
+	for (;;) {
+		uint32_t i = c->hand;
+		struct slot *s = &c->slots[i];
+
+		c->hand = (c->hand + 1) % c->nr_slots;
+		if (!s->valid)
+			return i;
+		if (s->referenced) {
+			s->referenced = false;
+			continue;
+		}
+
+		unlink_slot(c, i);
+		s->valid = false;
+		return i;
+	}
+}
+
+static void insert(struct bcache *c, uint32_t blk, const void *block, bool referenced)
+{
+	uint32_t i = evict(c);
+	struct slot *s = &c->slots[i];
+	uint32_t *b = bucket_of(c, blk);
+
+	memcpy(c->data + (size_t)i * c->block_size, block, c->block_size);
+	s->blk = blk;
+	s->valid = true;
+	s->referenced = referenced;
+	s->next = *b;
+	*b = i;
+}
+
+static int read_blocks(struct bcache *c, uint32_t blk, size_t nr, void *buf)
+{
+	size_t len = nr * c->block_size;
+	off_t off = (off_t)blk * c->block_size;
+
+	stats_add(CNT_IMG_READS, 1);
+	stats_add(CNT_IMG_BYTES, len);
+
+	while (len > 0) {
+		ssize_t n = pread(c->fd, buf, len, off);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		if (n == 0)
+			return -EIO;
+		buf = (char *)buf + n;
+		len -= n;
+		off += n;
+	}
+	return 0;
+}
+
+int bcache_read(struct bcache *c, uint32_t blk, void *buf, size_t off, size_t len)
+{
+	if (off > c->block_size || len > c->block_size - off)
+		return -EINVAL;
+
+	pthread_mutex_lock(&c->lock);
+	uint32_t i = lookup(c, blk);
+	if (i != NO_SLOT) {
+		c->slots[i].referenced = true;
+		memcpy(buf, c->data + (size_t)i * c->block_size + off, len);
+		pthread_mutex_unlock(&c->lock);
+		stats_add(CNT_CACHE_HITS, 1);
+		return 0;
+	}
+	pthread_mutex_unlock(&c->lock);
+	stats_add(CNT_CACHE_MISSES, 1);
+
+	char *block = fs_xmalloc(c->block_size);
+	int r = read_blocks(c, blk, 1, block);
+	if (r < 0) {
+		fs_xfree(block);
+		return r;
+	}
+
+	pthread_mutex_lock(&c->lock);
+	/* Another thread could have read the same block meanwhile. */
+	if (lookup(c, blk) == NO_SLOT)
+		insert(c, blk, block, true);
+	pthread_mutex_unlock(&c->lock);
+
+	memcpy(buf, block + off, len);
+	fs_xfree(block);
+	return 0;
+}
+
+int bcache_fill(struct bcache *c, uint32_t blk, size_t n)
+{
+	/* Never let a single fill evict more than half of the cache. */
+	if (n > c->nr_slots / 2)
+		n = c->nr_slots / 2;
+
+	/* Skip blocks at both ends that are cached already. */
+	pthread_mutex_lock(&c->lock);
+	while (n > 0 && lookup(c, blk) != NO_SLOT) {
+		++blk;
+		--n;
+	}
+	while (n > 0 && lookup(c, blk + n - 1) != NO_SLOT)
+		--n;
+	pthread_mutex_unlock(&c->lock);
+
+	if (n == 0)
+		return 0;
+
+	char *blocks = fs_xmalloc(n * c->block_size);
+	int r = read_blocks(c, blk, n, blocks);
+	if (r < 0) {
+		fs_xfree(blocks);
+		return r;
+	}
+
+	size_t nr_added = 0;
+	pthread_mutex_lock(&c->lock);
+	for (size_t i = 0; i < n; ++i) {
+		if (lookup(c, blk + i) == NO_SLOT) {
+			insert(c, blk + i, blocks + i * c->block_size, false);
+			++nr_added;
+		}
+	}
+	pthread_mutex_unlock(&c->lock);
+	stats_add(CNT_PREFETCHED_BLOCKS, nr_added);
+
+	fs_xfree(blocks);
+	return 0;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+   A cache of image blocks shared by all FUSE threads. Blocks are
+   evicted with the clock algorithm. Misses are read from the image
+   without holding the cache lock, so a slow read does not stall hits
+   in other threads.
+ */
+struct bcache;
+
+/* Create a cache of @nr_blocks blocks of @block_size bytes read from @fd. */
+int bcache_init(struct bcache **c, int fd, uint32_t block_size, size_t nr_blocks);
+void bcache_free(struct bcache *c);
+
+/* Copy @len bytes at offset @off of block @blk into @buf. */
+int bcache_read(struct bcache *c, uint32_t blk, void *buf, size_t off, size_t len);
+
+/*
+   Read blocks [@blk, @blk + @n) that are not cached yet with a single
+   pread(), and add them to the cache. Prefetched blocks are the first
+   to be evicted unless they are read before the clock hand comes by.
+ */
+int bcache_fill(struct bcache *c, uint32_t blk, size_t n);
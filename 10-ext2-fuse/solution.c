@@ -1,15 +1,844 @@
 #include <solution.h>
+#include <bcache.h>
+#include <workqueue.h>
+#include <stats.h>
+#include <fs_ext2.h>
+#include <fs_malloc.h>
 
 #include <fuse.h>
 
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+/* The size of the block cache. */
+#define CACHE_BYTES (64 << 20)
+
+/*
+   Readahead starts with a window of RA_MIN_BYTES once a file is read
+   sequentially, and the window doubles every time the reader catches
+   up with half of it, up to RA_MAX_BYTES.
+ */
+#define RA_MIN_BYTES (128 << 10)
+#define RA_MAX_BYTES (4 << 20)
+#define RA_THREADS 2
+#define RA_MAX_PENDING 64
+
+/* Files at the root of the mount that show statistics of the mount itself. */
+#define STATS_FILE "/.ext2fuse-stats"
+#define METRICS_FILE "/.ext2fuse-metrics"
+
+/* The image, with a block cache that metadata and data are read through. */
+struct ext2fs
+{
+	struct fs_ext2 base;
+	struct bcache *cache;
+	struct workqueue *readahead;
+};
+
+/*
+   The access pattern of an open file, in bytes: reads need not be
+   block aligned, a 4K page read of a 64K block file is not.
+ */
+struct readahead
+{
+	/* The offset that follows the last read. */
+	uint64_t next;
+	/* The current window, 0 if the file is not read sequentially. */
+	uint64_t size;
+	/* The offset that follows the last prefetched block. */
+	uint64_t end;
+};
+
+/*
+   State of an open file. A regular file keeps its inode, so reads do
+   not look it up again. A statistics file keeps a snapshot rendered
+   at open, so readers see a consistent picture.
+ */
+struct handle
+{
+	struct ext2_inode inode;
+	pthread_mutex_t lock;
+	struct readahead ra;
+
+	char *data;
+	size_t len;
+};
+
+static struct ext2fs* get_fs(void)
+{
+	return fuse_get_context()->private_data;
+}
+
+static int fs_load(struct ext2fs *fs, int img)
+{
+	int r = fs_ext2_load(&fs->base, img);
+	if (r < 0)
+		return r;
+
+	r = bcache_init(&fs->cache, img, fs->base.block_size, CACHE_BYTES / fs->base.block_size);
+	if (r < 0)
+		goto out_base;
+
+	r = workqueue_init(&fs->readahead, RA_THREADS, RA_MAX_PENDING);
+	if (r < 0)
+		goto out_cache;
+	return 0;
+
+out_cache:
+	bcache_free(fs->cache);
+out_base:
+	fs_ext2_free(&fs->base);
+	return r;
+}
+
+static void fs_free(struct ext2fs *fs)
+{
+	workqueue_free(fs->readahead);
+	bcache_free(fs->cache);
+	fs_ext2_free(&fs->base);
+}
+
+static int read_inode(const struct ext2fs *fs, uint32_t ino, struct ext2_inode *inode)
+{
+	if (ino == 0 || ino > fs->base.sb.s_inodes_count)
+		return -EIO;
+
+	uint32_t group = (ino - 1) / fs->base.sb.s_inodes_per_group;
+	uint32_t index = (ino - 1) % fs->base.sb.s_inodes_per_group;
+	if (group >= fs->base.nr_groups)
+		return -EIO;
+
+	uint64_t off = (uint64_t)index * fs->base.inode_size;
+	return bcache_read(fs->cache, fs->base.gdt[group].bg_inode_table + off / fs->base.block_size,
+			   inode, off % fs->base.block_size, sizeof(*inode));
+}
+
+static int read_ptr(const struct ext2fs *fs, uint32_t blk, uint32_t idx, uint32_t *out)
+{
+	if (blk == 0) {
+		*out = 0;
+		return 0;
+	}
+	if (blk >= fs->base.sb.s_blocks_count)
+		return -EIO;
+	return bcache_read(fs->cache, blk, out, idx * sizeof(*out), sizeof(*out));
+}
+
+/* Map a logical block @lbn of @inode to a physical one, 0 for a hole. */
+static int map_block(const struct ext2fs *fs, const struct ext2_inode *inode,
+		     uint64_t lbn, uint32_t *pbn)
+{
+	const uint32_t *b = inode->i_block;
+	uint64_t per = fs->base.block_size / sizeof(uint32_t);
+	uint32_t x;
+	int r;
+
+	if (lbn < EXT2_NDIR_BLOCKS) {
+		x = b[lbn];
+	} else if ((lbn -= EXT2_NDIR_BLOCKS) < per) {
+		if ((r = read_ptr(fs, b[EXT2_IND_BLOCK], lbn, &x)) < 0)
+			return r;
+	} else if ((lbn -= per) < per * per) {
+		if ((r = read_ptr(fs, b[EXT2_DIND_BLOCK], lbn / per, &x)) < 0 ||
+		    (r = read_ptr(fs, x, lbn % per, &x)) < 0)
+			return r;
+	} else if ((lbn -= per * per) < per * per * per) {
+		if ((r = read_ptr(fs, b[EXT2_TIND_BLOCK], lbn / (per * per), &x)) < 0 ||
+		    (r = read_ptr(fs, x, lbn / per % per, &x)) < 0 ||
+		    (r = read_ptr(fs, x, lbn % per, &x)) < 0)
+			return r;
+	} else {
+		return -EFBIG;
+	}
+
+	if (x >= fs->base.sb.s_blocks_count)
+		return -EIO;
+	*pbn = x;
+	return 0;
+}
+
+/*
+   Call @fn for every entry of a directory @dir, until it returns
+   non-zero. Return that value, 0 at the end of the directory, or
+   a negative error.
+ */
+static int for_each_entry(const struct ext2fs *fs, const struct ext2_inode *dir,
+			  int (*fn)(const struct ext2_dir_entry *de, void *arg), void *arg)
+{
+	size_t bs = fs->base.block_size;
+	uint64_t nr_blocks = (fs_ext2_inode_size(&fs->base, dir) + bs - 1) / bs;
+	char *block = fs_xmalloc(bs);
+	int r = 0;
+
+	for (uint64_t lbn = 0; lbn < nr_blocks && r == 0; ++lbn) {
+		uint32_t pbn;
+		if ((r = map_block(fs, dir, lbn, &pbn)) < 0)
+			break;
+		/* Directories are never sparse. */
+		if (pbn == 0) {
+			r = -EIO;
+			break;
+		}
+		if ((r = bcache_read(fs->cache, pbn, block, 0, bs)) < 0)
+			break;
+
+		for (size_t off = 0; off < bs && r == 0; ) {
+			const struct ext2_dir_entry *de = (const void *)(block + off);
+			if (bs - off < sizeof(*de) || de->rec_len < sizeof(*de) ||
+			    de->rec_len % 4 || de->rec_len > bs - off ||
+			    de->name_len > de->rec_len - sizeof(*de)) {
+				r = -EIO;
+				break;
+			}
+			if (de->inode)
+				r = fn(de, arg);
+			off += de->rec_len;
+		}
+	}
+
+	fs_xfree(block);
+	return r;
+}
+
+struct lookup
+{
+	const char *name;
+	size_t len;
+	uint32_t ino;
+};
+
+static int match_entry(const struct ext2_dir_entry *de, void *arg)
+{
+	struct lookup *l = arg;
+
+	if (de->name_len != l->len || memcmp(de->name, l->name, l->len) != 0)
+		return 0;
+	l->ino = de->inode;
+	return 1;
+}
+
+/* Resolve an absolute @path into an inode number and its inode. */
+static int lookup_path(const struct ext2fs *fs, const char *path,
+		       uint32_t *ino, struct ext2_inode *inode)
+{
+	uint32_t cur = EXT2_ROOT_INO;
+	int r;
+
+	if ((r = read_inode(fs, cur, inode)) < 0)
+		return r;
+
+	for (;;) {
+		while (*path == '/')
+			++path;
+		if (*path == '\0')
+			break;
+
+		struct lookup l = {path, strcspn(path, "/"), 0};
+		path += l.len;
+
+		if (!S_ISDIR(inode->i_mode))
+			return -ENOTDIR;
+		if (l.len > EXT2_NAME_LEN)
+			return -ENAMETOOLONG;
+
+		r = for_each_entry(fs, inode, match_entry, &l);
+		if (r < 0)
+			return r;
+		if (r == 0)
+			return -ENOENT;
+
+		cur = l.ino;
+		if ((r = read_inode(fs, cur, inode)) < 0)
+			return r;
+	}
+
+	*ino = cur;
+	return 0;
+}
+
+static bool is_stats_file(const char *path)
+{
+	return strcmp(path, STATS_FILE) == 0 || strcmp(path, METRICS_FILE) == 0;
+}
+
+static int do_getattr(const char *path, struct stat *st)
+{
+	const struct ext2fs *fs = get_fs();
+	struct ext2_inode inode;
+	uint32_t ino;
+	int r;
+
+	memset(st, 0, sizeof(*st));
+
+	if (is_stats_file(path)) {
+		/* The size is unknown until the file is rendered, so it is
+		   opened with direct I/O and read up to EOF. */
+		st->st_mode = S_IFREG | 0444;
+		st->st_nlink = 1;
+		return 0;
+	}
+
+	if ((r = lookup_path(fs, path, &ino, &inode)) < 0)
+		return r;
+
+	st->st_ino = ino;
+	st->st_mode = inode.i_mode;
+	st->st_nlink = inode.i_links_count;
+	st->st_uid = inode.i_uid;
+	st->st_gid = inode.i_gid;
+	st->st_size = fs_ext2_inode_size(&fs->base, &inode);
+	st->st_blksize = fs->base.block_size;
+	st->st_blocks = inode.i_blocks;
+	st->st_atim.tv_sec = inode.i_atime;
+	st->st_mtim.tv_sec = inode.i_mtime;
+	st->st_ctim.tv_sec = inode.i_ctime;
+	return 0;
+}
+
+static int ext2_getattr(const char *path, struct stat *st, struct fuse_file_info *fi)
+{
+	(void) fi;
+
+	uint64_t t = stats_now();
+	return stats_op_done(OP_GETATTR, t, do_getattr(path, st));
+}
+
+static int do_readlink(const char *path, char *buf, size_t size)
+{
+	const struct ext2fs *fs = get_fs();
+	struct ext2_inode inode;
+	uint32_t ino;
+	int r;
+
+	if (size == 0)
+		return -EINVAL;
+	if ((r = lookup_path(fs, path, &ino, &inode)) < 0)
+		return r;
+	if (!S_ISLNK(inode.i_mode))
+		return -EINVAL;
+
+	size_t len = inode.i_size;
+	if (len >= size)
+		len = size - 1;
+
+	/* A fast symlink keeps its target in i_block and has no data blocks. */
+	uint32_t acl_blocks = inode.i_file_acl ? fs->base.block_size / 512 : 0;
+	if (inode.i_blocks == acl_blocks) {
+		if (len > sizeof(inode.i_block))
+			return -EIO;
+		memcpy(buf, inode.i_block, len);
+	} else {
+		if (len > fs->base.block_size)
+			len = fs->base.block_size;
+		if (inode.i_block[0] == 0 || inode.i_block[0] >= fs->base.sb.s_blocks_count)
+			return -EIO;
+		if ((r = bcache_read(fs->cache, inode.i_block[0], buf, 0, len)) < 0)
+			return r;
+	}
+
+	buf[len] = '\0';
+	return 0;
+}
+
+static int ext2_readlink(const char *path, char *buf, size_t size)
+{
+	uint64_t t = stats_now();
+	return stats_op_done(OP_READLINK, t, do_readlink(path, buf, size));
+}
+
+static int do_open(const char *path, struct fuse_file_info *fi)
+{
+	const struct ext2fs *fs = get_fs();
+	struct handle *h;
+	uint32_t ino;
+	int r;
+
+	if ((fi->flags & O_ACCMODE) != O_RDONLY)
+		return -EROFS;
+
+	h = fs_xzalloc(sizeof(*h));
+
+	if (strcmp(path, STATS_FILE) == 0) {
+		h->data = stats_render_text(&h->len);
+		fi->direct_io = 1;
+	} else if (strcmp(path, METRICS_FILE) == 0) {
+		h->data = stats_render_prometheus(&h->len);
+		fi->direct_io = 1;
+	} else {
+		if ((r = lookup_path(fs, path, &ino, &h->inode)) < 0)
+			goto out_free;
+		if (S_ISDIR(h->inode.i_mode)) {
+			r = -EISDIR;
+			goto out_free;
+		}
+		pthread_mutex_init(&h->lock, NULL);
+		fi->keep_cache = 1;
+	}
+
+	fi->fh = (uintptr_t)h;
+	return 0;
+
+out_free:
+	fs_xfree(h);
+	return r;
+}
+
+static int ext2_open(const char *path, struct fuse_file_info *fi)
+{
+	uint64_t t = stats_now();
+	return stats_op_done(OP_OPEN, t, do_open(path, fi));
+}
+
+struct ra_job
+{
+	const struct ext2fs *fs;
+	struct ext2_inode inode;
+	uint64_t lbn;
+	uint64_t n;
+};
+
+/* Fill the cache with blocks of a readahead window, one pread() per
+   run of physically contiguous blocks. Errors are left for the reader
+   to see when it gets there. */
+static void run_readahead(void *arg)
+{
+	struct ra_job *job = arg;
+	uint32_t start = 0;
+	size_t len = 0;
+
+	for (uint64_t i = 0; i < job->n; ++i) {
+		uint32_t pbn;
+		if (map_block(job->fs, &job->inode, job->lbn + i, &pbn) < 0)
+			break;
+
+		if (len && pbn == start + len) {
+			++len;
+			continue;
+		}
+		if (len)
+			bcache_fill(job->fs->cache, start, len);
+		start = pbn;
+		len = pbn ? 1 : 0;
+	}
+	if (len)
+		bcache_fill(job->fs->cache, start, len);
+
+	fs_xfree(job);
+}
+
+/*
+   Record a read of @size bytes at @off of @h, and prefetch ahead of it
+   if the file is being read sequentially. A read that does not continue
+   the previous one drops the window, so random access never prefetches.
+ */
+static void start_readahead(const struct ext2fs *fs, struct handle *h, uint64_t off, size_t size)
+{
+	struct readahead *ra = &h->ra;
+	uint64_t bs = fs->base.block_size;
+	uint64_t file_end = (fs_ext2_inode_size(&fs->base, &h->inode) + bs - 1) / bs * bs;
+	uint64_t end = off + size;
+	uint64_t from = 0, to = 0;
+
+	pthread_mutex_lock(&h->lock);
+	if (off != ra->next) {
+		ra->size = 0;
+		ra->end = 0;
+	} else if (ra->size == 0 || end + ra->size / 2 >= ra->end) {
+		ra->size = ra->size == 0 ? RA_MIN_BYTES : ra->size * 2;
+		if (ra->size > RA_MAX_BYTES)
+			ra->size = RA_MAX_BYTES;
+
+		/* Prefetch whole blocks, the window ends on a block
+		   boundary and the next one starts where it ended. */
+		from = (ra->end > end ? ra->end : end) / bs * bs;
+		to = (end + ra->size + bs - 1) / bs * bs;
+		if (to > file_end)
+			to = file_end;
+		if (from < to)
+			ra->end = to;
+	}
+	ra->next = end;
+	pthread_mutex_unlock(&h->lock);
+
+	if (from >= to)
+		return;
+
+	struct ra_job *job = fs_xmalloc(sizeof(*job));
+	*job = (struct ra_job){fs, h->inode, from / bs, (to - from) / bs};
+	if (!workqueue_submit(fs->readahead, run_readahead, job)) {
+		/* The readers are ahead of the workers, forget the window
+		   so that a later read starts it again. */
+		pthread_mutex_lock(&h->lock);
+		if (ra->end == to)
+			ra->end = from;
+		pthread_mutex_unlock(&h->lock);
+		fs_xfree(job);
+	}
+}
+
+static int do_read(char *buf, size_t size, off_t off, struct fuse_file_info *fi)
+{
+	const struct ext2fs *fs = get_fs();
+	struct handle *h = (struct handle *)(uintptr_t)fi->fh;
+
+	if (off < 0)
+		return -EINVAL;
+
+	if (h->data) {
+		if ((size_t)off >= h->len)
+			return 0;
+		if (size > h->len - off)
+			size = h->len - off;
+		memcpy(buf, h->data + off, size);
+		return size;
+	}
+
+	uint64_t file_size = fs_ext2_inode_size(&fs->base, &h->inode);
+	if ((uint64_t)off >= file_size)
+		return 0;
+	if (size > file_size - off)
+		size = file_size - off;
+
+	start_readahead(fs, h, off, size);
+
+	size_t bs = fs->base.block_size;
+
+	size_t done = 0;
+	while (done < size) {
+		uint64_t pos = off + done;
+		size_t in_block = pos % bs;
+		size_t len = bs - in_block;
+		if (len > size - done)
+			len = size - done;
+
+		uint32_t pbn;
+		int r = map_block(fs, &h->inode, pos / bs, &pbn);
+		if (r < 0)
+			return r;
+
+		if (pbn == 0)
+			memset(buf + done, 0, len);
+		else if ((r = bcache_read(fs->cache, pbn, buf + done, in_block, len)) < 0)
+			return r;
+		done += len;
+	}
+	return done;
+}
+
+static int ext2_read(const char *path, char *buf, size_t size, off_t off,
+		     struct fuse_file_info *fi)
+{
+	(void) path;
+
+	uint64_t t = stats_now();
+	return stats_op_done(OP_READ, t, do_read(buf, size, off, fi));
+}
+
+static int ext2_release(const char *path, struct fuse_file_info *fi)
+{
+	(void) path;
+
+	uint64_t t = stats_now();
+	struct handle *h = (struct handle *)(uintptr_t)fi->fh;
+	if (!h->data)
+		pthread_mutex_destroy(&h->lock);
+	fs_xfree(h->data);
+	fs_xfree(h);
+	return stats_op_done(OP_RELEASE, t, 0);
+}
+
+static int do_statfs(struct statvfs *st)
+{
+	const struct ext2fs *fs = get_fs();
+	const struct ext2_super_block *sb = &fs->base.sb;
+
+	memset(st, 0, sizeof(*st));
+	st->f_bsize = fs->base.block_size;
+	st->f_frsize = fs->base.block_size;
+	st->f_blocks = sb->s_blocks_count;
+	st->f_bfree = sb->s_free_blocks_count;
+	st->f_bavail = sb->s_free_blocks_count > sb->s_r_blocks_count ?
+		sb->s_free_blocks_count - sb->s_r_blocks_count : 0;
+	st->f_files = sb->s_inodes_count;
+	st->f_ffree = sb->s_free_inodes_count;
+	st->f_favail = sb->s_free_inodes_count;
+	st->f_flag = ST_RDONLY;
+	st->f_namemax = EXT2_NAME_LEN;
+	return 0;
+}
+
+static int ext2_statfs(const char *path, struct statvfs *st)
+{
+	(void) path;
+
+	uint64_t t = stats_now();
+	return stats_op_done(OP_STATFS, t, do_statfs(st));
+}
+
+static int do_opendir(const char *path)
+{
+	struct ext2_inode inode;
+	uint32_t ino;
+	int r;
+
+	if ((r = lookup_path(get_fs(), path, &ino, &inode)) < 0)
+		return r;
+	return S_ISDIR(inode.i_mode) ? 0 : -ENOTDIR;
+}
+
+static int ext2_opendir(const char *path, struct fuse_file_info *fi)
+{
+	(void) fi;
+
+	uint64_t t = stats_now();
+	return stats_op_done(OP_OPENDIR, t, do_opendir(path));
+}
+
+struct fill
+{
+	void *buf;
+	fuse_fill_dir_t filler;
+	char name[EXT2_NAME_LEN + 1];
+};
+
+static int fill_entry(const struct ext2_dir_entry *de, void *arg)
+{
+	struct fill *f = arg;
+
+	memcpy(f->name, de->name, de->name_len);
+	f->name[de->name_len] = '\0';
+	/* A full buffer ends the listing, the entries fit in one call
+	   with offsets being always 0. */
+	return f->filler(f->buf, f->name, NULL, 0, 0) ? 1 : 0;
+}
+
+static int do_readdir(const char *path, void *buf, fuse_fill_dir_t filler)
+{
+	const struct ext2fs *fs = get_fs();
+	struct ext2_inode inode;
+	uint32_t ino;
+	int r;
+
+	if ((r = lookup_path(fs, path, &ino, &inode)) < 0)
+		return r;
+	if (!S_ISDIR(inode.i_mode))
+		return -ENOTDIR;
+
+	struct fill *f = fs_xmalloc(sizeof(*f));
+	f->buf = buf;
+	f->filler = filler;
+	r = for_each_entry(fs, &inode, fill_entry, f);
+	fs_xfree(f);
+	if (r < 0)
+		return r;
+
+	if (ino == EXT2_ROOT_INO) {
+		filler(buf, STATS_FILE + 1, NULL, 0, 0);
+		filler(buf, METRICS_FILE + 1, NULL, 0, 0);
+	}
+	return 0;
+}
+
+static int ext2_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t off,
+			struct fuse_file_info *fi, enum fuse_readdir_flags flags)
+{
+	(void) off;
+	(void) fi;
+	(void) flags;
+
+	uint64_t t = stats_now();
+	return stats_op_done(OP_READDIR, t, do_readdir(path, buf, filler));
+}
+
+static int ext2_releasedir(const char *path, struct fuse_file_info *fi)
+{
+	(void) path;
+	(void) fi;
+
+	uint64_t t = stats_now();
+	return stats_op_done(OP_RELEASEDIR, t, 0);
+}
+
+/* The file system is read-only, every modification fails with EROFS. */
+
+static int ext2_mknod(const char *path, mode_t mode, dev_t dev)
+{
+	(void) path;
+	(void) mode;
+	(void) dev;
+
+	return stats_op_done(OP_MKNOD, stats_now(), -EROFS);
+}
+
+static int ext2_mkdir(const char *path, mode_t mode)
+{
+	(void) path;
+	(void) mode;
+
+	return stats_op_done(OP_MKDIR, stats_now(), -EROFS);
+}
+
+static int ext2_unlink(const char *path)
+{
+	(void) path;
+
+	return stats_op_done(OP_UNLINK, stats_now(), -EROFS);
+}
+
+static int ext2_rmdir(const char *path)
+{
+	(void) path;
+
+	return stats_op_done(OP_RMDIR, stats_now(), -EROFS);
+}
+
+static int ext2_symlink(const char *target, const char *path)
+{
+	(void) target;
+	(void) path;
+
+	return stats_op_done(OP_SYMLINK, stats_now(), -EROFS);
+}
+
+static int ext2_rename(const char *from, const char *to, unsigned int flags)
+{
+	(void) from;
+	(void) to;
+	(void) flags;
+
+	return stats_op_done(OP_RENAME, stats_now(), -EROFS);
+}
+
+static int ext2_link(const char *from, const char *to)
+{
+	(void) from;
+	(void) to;
+
+	return stats_op_done(OP_LINK, stats_now(), -EROFS);
+}
+
+static int ext2_chmod(const char *path, mode_t mode, struct fuse_file_info *fi)
+{
+	(void) path;
+	(void) mode;
+	(void) fi;
+
+	return stats_op_done(OP_CHMOD, stats_now(), -EROFS);
+}
+
+static int ext2_chown(const char *path, uid_t uid, gid_t gid, struct fuse_file_info *fi)
+{
+	(void) path;
+	(void) uid;
+	(void) gid;
+	(void) fi;
+
+	return stats_op_done(OP_CHOWN, stats_now(), -EROFS);
+}
+
+static int ext2_truncate(const char *path, off_t size, struct fuse_file_info *fi)
+{
+	(void) path;
+	(void) size;
+	(void) fi;
+
+	return stats_op_done(OP_TRUNCATE, stats_now(), -EROFS);
+}
+
+static int ext2_write(const char *path, const char *buf, size_t size, off_t off,
+		      struct fuse_file_info *fi)
+{
+	(void) path;
+	(void) buf;
+	(void) size;
+	(void) off;
+	(void) fi;
+
+	return stats_op_done(OP_WRITE, stats_now(), -EROFS);
+}
+
+static int ext2_setxattr(const char *path, const char *name, const char *value,
+			 size_t size, int flags)
+{
+	(void) path;
+	(void) name;
+	(void) value;
+	(void) size;
+	(void) flags;
+
+	return stats_op_done(OP_SETXATTR, stats_now(), -EROFS);
+}
+
+static int ext2_removexattr(const char *path, const char *name)
+{
+	(void) path;
+	(void) name;
+
+	return stats_op_done(OP_REMOVEXATTR, stats_now(), -EROFS);
+}
+
+static int ext2_create(const char *path, mode_t mode, struct fuse_file_info *fi)
+{
+	(void) path;
+	(void) mode;
+	(void) fi;
+
+	return stats_op_done(OP_CREATE, stats_now(), -EROFS);
+}
+
+static int ext2_utimens(const char *path, const struct timespec tv[2],
+			struct fuse_file_info *fi)
+{
+	(void) path;
+	(void) tv;
+	(void) fi;
+
+	return stats_op_done(OP_UTIMENS, stats_now(), -EROFS);
+}
+
 static const struct fuse_operations ext2_ops = {
-	/* implement me */
+	.getattr = ext2_getattr,
+	.readlink = ext2_readlink,
+	.mknod = ext2_mknod,
+	.mkdir = ext2_mkdir,
+	.unlink = ext2_unlink,
+	.rmdir = ext2_rmdir,
+	.symlink = ext2_symlink,
+	.rename = ext2_rename,
+	.link = ext2_link,
+	.chmod = ext2_chmod,
+	.chown = ext2_chown,
+	.truncate = ext2_truncate,
+	.open = ext2_open,
+	.read = ext2_read,
+	.write = ext2_write,
+	.statfs = ext2_statfs,
+	.release = ext2_release,
+	.setxattr = ext2_setxattr,
+	.removexattr = ext2_removexattr,
+	.opendir = ext2_opendir,
+	.readdir = ext2_readdir,
+	.releasedir = ext2_releasedir,
+	.create = ext2_create,
+	.utimens = ext2_utimens,
 };
 
 int ext2fuse(int img, const char *mntp)
 {
-	(void) img;
+	struct ext2fs fs;
+	int r;
+
+	if ((r = fs_load(&fs, img)) < 0)
+		return r;
 
 	char *argv[] = {"exercise", "-f", (char *)mntp, NULL};
-	return fuse_main(3, argv, &ext2_ops, NULL);
+	r = fuse_main(3, argv, &ext2_ops, &fs);
+
+	fs_free(&fs);
+	return r;
 }
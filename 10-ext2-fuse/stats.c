@@ -0,0 +1,294 @@
+#include <stats.h>
+#include <fs_malloc.h>
+#include <fs_string.h>
+
+#include <err.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <time.h>
+
+/* Bucket k counts latencies in [2^(k-1), 2^k) ns, the last one
+   also counts everything above. 2^39 ns is about 9 minutes. */
+#define NR_BUCKETS 40
+
+static const char *const op_names[NR_OPS] = {
+	[OP_GETATTR] = "getattr",
+	[OP_READLINK] = "readlink",
+	[OP_MKNOD] = "mknod",
+	[OP_MKDIR] = "mkdir",
+	[OP_UNLINK] = "unlink",
+	[OP_RMDIR] = "rmdir",
+	[OP_SYMLINK] = "symlink",
+	[OP_RENAME] = "rename",
+	[OP_LINK] = "link",
+	[OP_CHMOD] = "chmod",
+	[OP_CHOWN] = "chown",
+	[OP_TRUNCATE] = "truncate",
+	[OP_OPEN] = "open",
+	[OP_READ] = "read",
+	[OP_WRITE] = "write",
+	[OP_STATFS] = "statfs",
+	[OP_RELEASE] = "release",
+	[OP_SETXATTR] = "setxattr",
+	[OP_REMOVEXATTR] = "removexattr",
+	[OP_OPENDIR] = "opendir",
+	[OP_READDIR] = "readdir",
+	[OP_RELEASEDIR] = "releasedir",
+	[OP_CREATE] = "create",
+	[OP_UTIMENS] = "utimens",
+};
+
+struct counts
+{
+	uint64_t calls[NR_OPS];
+	uint64_t errors[NR_OPS];
+	uint64_t total_ns[NR_OPS];
+	uint64_t hist[NR_OPS][NR_BUCKETS];
+	uint64_t counters[NR_COUNTERS];
+};
+
+/*
+   Statistics recorded by one thread. Only the owner writes to a shard,
+   so updates are plain read-modify-write sequences published with
+   relaxed stores. When the thread exits, its counts are added to the
+   retired ones and the shard is freed, so the number of shards stays
+   bounded by the number of live threads.
+ */
+struct shard
+{
+	struct shard *prev;
+	struct shard *next;
+	struct counts c;
+};
+
+/* Protects the list of shards and the counts of exited threads. */
+static pthread_mutex_t shards_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct shard *shards;
+static struct counts retired;
+
+static pthread_once_t shard_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t shard_key;
+static __thread struct shard *local;
+
+static inline uint64_t load(const uint64_t *x)
+{
+	return __atomic_load_n(x, __ATOMIC_RELAXED);
+}
+
+/* Add @src, which its owner may be updating, to @dst. */
+static void add_counts(struct counts *dst, const struct counts *src)
+{
+	for (int op = 0; op < NR_OPS; ++op) {
+		dst->calls[op] += load(&src->calls[op]);
+		dst->errors[op] += load(&src->errors[op]);
+		dst->total_ns[op] += load(&src->total_ns[op]);
+		for (int b = 0; b < NR_BUCKETS; ++b)
+			dst->hist[op][b] += load(&src->hist[op][b]);
+	}
+	for (int c = 0; c < NR_COUNTERS; ++c)
+		dst->counters[c] += load(&src->counters[c]);
+}
+
+/* Called when a thread that has a shard exits. */
+static void retire_shard(void *arg)
+{
+	struct shard *s = arg;
+
+	pthread_mutex_lock(&shards_lock);
+	add_counts(&retired, &s->c);
+	if (s->prev)
+		s->prev->next = s->next;
+	else
+		shards = s->next;
+	if (s->next)
+		s->next->prev = s->prev;
+	pthread_mutex_unlock(&shards_lock);
+
+	local = NULL;
+	fs_xfree(s);
+}
+
+static void create_shard_key(void)
+{
+	if (pthread_key_create(&shard_key, retire_shard) != 0)
+		errx(1, "failed to create the statistics key");
+}
+
+static struct shard* local_shard(void)
+{
+	if (local)
+		return local;
+
+	pthread_once(&shard_key_once, create_shard_key);
+
+	struct shard *s = fs_xzalloc(sizeof(*s));
+	pthread_mutex_lock(&shards_lock);
+	s->next = shards;
+	if (shards)
+		shards->prev = s;
+	shards = s;
+	pthread_mutex_unlock(&shards_lock);
+
+	pthread_setspecific(shard_key, s);
+	local = s;
+	return s;
+}
+
+static inline void bump(uint64_t *x, uint64_t n)
+{
+	__atomic_store_n(x, *x + n, __ATOMIC_RELAXED);
+}
+
+uint64_t stats_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int stats_op_done(enum stats_op op, uint64_t start, int result)
+{
+	struct shard *s = local_shard();
+	uint64_t ns = stats_now() - start;
+	int bucket = ns ? 64 - __builtin_clzll(ns) : 0;
+	if (bucket >= NR_BUCKETS)
+		bucket = NR_BUCKETS - 1;
+
+	bump(&s->c.calls[op], 1);
+	if (result < 0)
+		bump(&s->c.errors[op], 1);
+	bump(&s->c.total_ns[op], ns);
+	bump(&s->c.hist[op][bucket], 1);
+	return result;
+}
+
+void stats_add(enum stats_counter c, uint64_t n)
+{
+	bump(&local_shard()->c.counters[c], n);
+}
+
+/* Sum up the counts of exited threads and of all live shards. */
+static void take_snapshot(struct counts *snap)
+{
+	pthread_mutex_lock(&shards_lock);
+	*snap = retired;
+	for (struct shard *s = shards; s; s = s->next)
+		add_counts(snap, &s->c);
+	pthread_mutex_unlock(&shards_lock);
+}
+
+/* Return the upper bound of the bucket that holds the @q-quantile. */
+static uint64_t quantile_ns(const uint64_t *hist, uint64_t count, double q)
+{
+	uint64_t want = (uint64_t)(count * q);
+	uint64_t seen = 0;
+
+	for (int b = 0; b < NR_BUCKETS; ++b) {
+		seen += hist[b];
+		if (seen > want)
+			return 1ULL << b;
+	}
+	return 1ULL << (NR_BUCKETS - 1);
+}
+
+char* stats_render_text(size_t *len)
+{
+	struct counts *snap = fs_xmalloc(sizeof(*snap));
+	struct fs_strbuf b = FS_STRBUF_INIT;
+
+	take_snapshot(snap);
+
+	fs_strbuf_appendf(&b, "%-12s %12s %8s %12s %12s %12s\n",
+			  "op", "calls", "errors", "avg_ns", "p50_ns<", "p99_ns<");
+	for (int op = 0; op < NR_OPS; ++op) {
+		uint64_t n = snap->calls[op];
+		if (n == 0)
+			continue;
+		fs_strbuf_appendf(&b, "%-12s %12llu %8llu %12llu %12llu %12llu\n",
+				  op_names[op],
+				  (unsigned long long)n,
+				  (unsigned long long)snap->errors[op],
+				  (unsigned long long)(snap->total_ns[op] / n),
+				  (unsigned long long)quantile_ns(snap->hist[op], n, 0.5),
+				  (unsigned long long)quantile_ns(snap->hist[op], n, 0.99));
+	}
+
+	uint64_t hits = snap->counters[CNT_CACHE_HITS];
+	uint64_t misses = snap->counters[CNT_CACHE_MISSES];
+	fs_strbuf_appendf(&b, "\ncache: %llu hits, %llu misses, %.2f%% hit rate\n",
+			  (unsigned long long)hits, (unsigned long long)misses,
+			  hits + misses ? 100.0 * hits / (hits + misses) : 0.0);
+	fs_strbuf_appendf(&b, "image: %llu reads, %llu bytes\n",
+			  (unsigned long long)snap->counters[CNT_IMG_READS],
+			  (unsigned long long)snap->counters[CNT_IMG_BYTES]);
+	fs_strbuf_appendf(&b, "readahead: %llu blocks prefetched\n",
+			  (unsigned long long)snap->counters[CNT_PREFETCHED_BLOCKS]);
+
+	fs_xfree(snap);
+	*len = b.len;
+	return b.s;
+}
+
+static void prom_counter(struct fs_strbuf *b, const char *name, const char *help, uint64_t x)
+{
+	fs_strbuf_appendf(b, "# HELP %s %s\n# TYPE %s counter\n%s ", name, help, name, name);
+	fs_strbuf_append_uint(b, x);
+	fs_strbuf_appendc(b, '\n');
+}
+
+char* stats_render_prometheus(size_t *len)
+{
+	struct counts *snap = fs_xmalloc(sizeof(*snap));
+	struct fs_strbuf b = FS_STRBUF_INIT;
+
+	take_snapshot(snap);
+
+	fs_strbuf_appends(&b,
+		"# HELP ext2fuse_op_duration_seconds Latency of FUSE callbacks.\n"
+		"# TYPE ext2fuse_op_duration_seconds histogram\n");
+	for (int op = 0; op < NR_OPS; ++op) {
+		uint64_t cumulative = 0;
+		for (int k = 0; k < NR_BUCKETS - 1; ++k) {
+			cumulative += snap->hist[op][k];
+			fs_strbuf_appendf(&b, "ext2fuse_op_duration_seconds_bucket{op=\"%s\",le=\"%.9g\"} ",
+					  op_names[op], (double)(1ULL << k) / 1e9);
+			fs_strbuf_append_uint(&b, cumulative);
+			fs_strbuf_appendc(&b, '\n');
+		}
+		/* calls[] is bumped apart from hist[], so both +Inf and _count
+		   are taken from the buckets to keep them monotonic. */
+		cumulative += snap->hist[op][NR_BUCKETS - 1];
+		fs_strbuf_appendf(&b, "ext2fuse_op_duration_seconds_bucket{op=\"%s\",le=\"+Inf\"} ",
+				  op_names[op]);
+		fs_strbuf_append_uint(&b, cumulative);
+		fs_strbuf_appendf(&b, "\next2fuse_op_duration_seconds_sum{op=\"%s\"} %.9f\n",
+				  op_names[op], snap->total_ns[op] / 1e9);
+		fs_strbuf_appendf(&b, "ext2fuse_op_duration_seconds_count{op=\"%s\"} ", op_names[op]);
+		fs_strbuf_append_uint(&b, cumulative);
+		fs_strbuf_appendc(&b, '\n');
+	}
+
+	fs_strbuf_appends(&b,
+		"# HELP ext2fuse_op_errors_total FUSE callbacks that returned an error.\n"
+		"# TYPE ext2fuse_op_errors_total counter\n");
+	for (int op = 0; op < NR_OPS; ++op) {
+		fs_strbuf_appendf(&b, "ext2fuse_op_errors_total{op=\"%s\"} ", op_names[op]);
+		fs_strbuf_append_uint(&b, snap->errors[op]);
+		fs_strbuf_appendc(&b, '\n');
+	}
+
+	prom_counter(&b, "ext2fuse_cache_hits_total", "Block cache hits.",
+		     snap->counters[CNT_CACHE_HITS]);
+	prom_counter(&b, "ext2fuse_cache_misses_total", "Block cache misses.",
+		     snap->counters[CNT_CACHE_MISSES]);
+	prom_counter(&b, "ext2fuse_image_reads_total", "Reads issued to the image.",
+		     snap->counters[CNT_IMG_READS]);
+	prom_counter(&b, "ext2fuse_image_read_bytes_total", "Bytes read from the image.",
+		     snap->counters[CNT_IMG_BYTES]);
+	prom_counter(&b, "ext2fuse_prefetched_blocks_total", "Blocks added to the cache by readahead.",
+		     snap->counters[CNT_PREFETCHED_BLOCKS]);
+
+	fs_xfree(snap);
+	*len = b.len;
+	return b.s;
+}
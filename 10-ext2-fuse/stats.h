@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+   Counters and latency histograms of the FUSE filesystem. Every thread
+   records into its own shard, so recording is a handful of relaxed
+   stores without locks or contended cache lines. Readers sum up all
+   shards, and may see a snapshot that is slightly out of date.
+ */
+
+enum stats_op
+{
+	OP_GETATTR,
+	OP_READLINK,
+	OP_MKNOD,
+	OP_MKDIR,
+	OP_UNLINK,
+	OP_RMDIR,
+	OP_SYMLINK,
+	OP_RENAME,
+	OP_LINK,
+	OP_CHMOD,
+	OP_CHOWN,
+	OP_TRUNCATE,
+	OP_OPEN,
+	OP_READ,
+	OP_WRITE,
+	OP_STATFS,
+	OP_RELEASE,
+	OP_SETXATTR,
+	OP_REMOVEXATTR,
+	OP_OPENDIR,
+	OP_READDIR,
+	OP_RELEASEDIR,
+	OP_CREATE,
+	OP_UTIMENS,
+	NR_OPS,
+};
+
+enum stats_counter
+{
+	CNT_CACHE_HITS,
+	CNT_CACHE_MISSES,
+	CNT_IMG_READS,
+	CNT_IMG_BYTES,
+	CNT_PREFETCHED_BLOCKS,
+	NR_COUNTERS,
+};
+
+/* Return a monotonic timestamp in nanoseconds. */
+uint64_t stats_now(void);
+
+/* Record a call to @op that started at @start and returned @result,
+   and return @result. */
+int stats_op_done(enum stats_op op, uint64_t start, int result);
+
+void stats_add(enum stats_counter c, uint64_t n);
+
+/* Render all statistics into a heap-allocated string of @len bytes,
+   either as human-readable text or in the Prometheus text exposition
+   format. */
+char* stats_render_text(size_t *len);
+char* stats_render_prometheus(size_t *len);
@@ -0,0 +1,109 @@
+#include <workqueue.h>
+#include <fs_malloc.h>
+
+#include <pthread.h>
+#include <errno.h>
+
+struct job
+{
+	void (*fn)(void *arg);
+	void *arg;
+};
+
+struct workqueue
+{
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	bool stopping;
+
+	/* A ring of pending jobs. */
+	struct job *jobs;
+	size_t cap;
+	size_t head;
+	size_t nr;
+
+	int nr_threads;
+	pthread_t *threads;
+};
+
+static void* worker(void *arg)
+{
+	struct workqueue *wq = arg;
+
+	pthread_mutex_lock(&wq->lock);
+	for (;;) {
+		while (wq->nr == 0 && !wq->stopping)
+			pthread_cond_wait(&wq->cond, &wq->lock);
+		if (wq->nr == 0)
+			break;
+
+		struct job job = wq->jobs[wq->head];
+		wq->head = (wq->head + 1) % wq->cap;
+		--wq->nr;
+
+		pthread_mutex_unlock(&wq->lock);
+		job.fn(job.arg);
+		pthread_mutex_lock(&wq->lock);
+	}
+	pthread_mutex_unlock(&wq->lock);
+	return NULL;
+}
+
+int workqueue_init(struct workqueue **wq, int nr_threads, size_t max_pending)
+{
+	if (nr_threads <= 0 || max_pending == 0)
+		return -EINVAL;
+
+	struct workqueue *x = fs_xzalloc(sizeof(*x));
+	pthread_mutex_init(&x->lock, NULL);
+	pthread_cond_init(&x->cond, NULL);
+	x->cap = max_pending;
+	x->jobs = fs_xmalloc(max_pending * sizeof(x->jobs[0]));
+	x->threads = fs_xmalloc(nr_threads * sizeof(x->threads[0]));
+
+	for (; x->nr_threads < nr_threads; ++x->nr_threads) {
+		int r = pthread_create(&x->threads[x->nr_threads], NULL, worker, x);
+		if (r != 0) {
+			workqueue_free(x);
+			return -r;
+		}
+	}
+
+	*wq = x;
+	return 0;
+}
+
+void workqueue_free(struct workqueue *wq)
+{
+	if (!wq)
+		return;
+
+	pthread_mutex_lock(&wq->lock);
+	wq->stopping = true;
+	pthread_cond_broadcast(&wq->cond);
+	pthread_mutex_unlock(&wq->lock);
+
+	for (int i = 0; i < wq->nr_threads; ++i)
+		pthread_join(wq->threads[i], NULL);
+
+	pthread_cond_destroy(&wq->cond);
+	pthread_mutex_destroy(&wq->lock);
+	fs_xfree(wq->threads);
+	fs_xfree(wq->jobs);
+	fs_xfree(wq);
+}
+
+bool workqueue_submit(struct workqueue *wq, void (*fn)(void *arg), void *arg)
+{
+	pthread_mutex_lock(&wq->lock);
+	if (wq->nr == wq->cap || wq->stopping) {
+		pthread_mutex_unlock(&wq->lock);
+		return false;
+	}
+
+	wq->jobs[(wq->head + wq->nr) % wq->cap] = (struct job){fn, arg};
+	++wq->nr;
+	pthread_cond_signal(&wq->cond);
+	pthread_mutex_unlock(&wq->lock);
+	return true;
+}
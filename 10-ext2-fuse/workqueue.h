@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+   A fixed pool of threads running jobs from a bounded queue. It is
+   meant for best-effort background work, so a full queue rejects new
+   jobs instead of blocking the caller.
+ */
+struct workqueue;
+
+int workqueue_init(struct workqueue **wq, int nr_threads, size_t max_pending);
+
+/* Run the pending jobs, then stop and free the threads. */
+void workqueue_free(struct workqueue *wq);
+
+/* Queue a call to @fn(@arg). Return false if the queue is full,
+   and then @fn is never called. */
+bool workqueue_submit(struct workqueue *wq, void (*fn)(void *arg), void *arg);
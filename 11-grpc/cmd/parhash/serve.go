@@ -16,6 +16,7 @@ var serveFlags struct {
 	listenAddr  string
 	backends    []string
 	concurrency int
+	scheduler   string
 }
 
 var serveCmd = cobra.Command{
@@ -30,6 +31,8 @@ func init() {
 	f.StringVar(&serveFlags.listenAddr, "addr", "127.0.0.1:0", "listen addr")
 	f.StringArrayVar(&serveFlags.backends, "backends", []string{}, "addresses of backends")
 	f.IntVar(&serveFlags.concurrency, "concurrency", 4, "number of concurrent requests to backends")
+	f.StringVar(&serveFlags.scheduler, "scheduler", parhash.SchedRoundRobin,
+		"how to assign buffers to backends: "+parhash.SchedRoundRobin+" or "+parhash.SchedLeastOutstanding)
 
 	rootCmd.AddCommand(&serveCmd)
 }
@@ -42,6 +45,7 @@ func serve(cmd *cobra.Command, args []string) {
 		ListenAddr:   serveFlags.listenAddr,
 		BackendAddrs: serveFlags.backends,
 		Concurrency:  serveFlags.concurrency,
+		Scheduler:    serveFlags.scheduler,
 	})
 
 	if err := s.Start(ctx); err != nil {
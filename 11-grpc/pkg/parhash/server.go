@@ -2,15 +2,27 @@ package parhash
 
 import (
 	"context"
+	"io"
+	"net"
+	"sync"
+	"time"
 
 	"github.com/pkg/errors"
 	"golang.org/x/sync/semaphore"
+	"google.golang.org/grpc"
+
+	hashpb "fs101ex/pkg/gen/hashsvc"
+	parhashpb "fs101ex/pkg/gen/parhashsvc"
+	"fs101ex/pkg/workgroup"
 )
 
 type Config struct {
 	ListenAddr   string
 	BackendAddrs []string
 	Concurrency  int
+
+	// One of Sched* constants, SchedRoundRobin if empty.
+	Scheduler string
 }
 
 // Implement a server that responds to ParallelHash()
@@ -35,10 +47,21 @@ type Config struct {
 // WARNING: requests to ParallelHash() may be concurrent, too.
 // Make sure that the round-robin fanout works in that case too,
 // and evenly distributes the load across backends.
+//
+// Config.Scheduler may replace the round-robin fanout with
+// SchedLeastOutstanding, which keeps a slow backend from stalling every
+// call that has a buffer assigned to it.
 type Server struct {
 	conf Config
 
 	sem *semaphore.Weighted
+
+	stop context.CancelFunc
+	l    net.Listener
+	wg   sync.WaitGroup
+
+	backends []*backend
+	sched    scheduler
 }
 
 func New(conf Config) *Server {
@@ -50,17 +73,325 @@ func New(conf Config) *Server {
 
 func (s *Server) Start(ctx context.Context) (err error) {
 	defer func() { err = errors.Wrap(err, "Start()") }()
+	defer func() {
+		if err != nil {
+			s.closeBackends()
+		}
+	}()
 
-	/* implement me */
+	for _, addr := range s.conf.BackendAddrs {
+		conn, err := grpc.Dial(addr,
+			grpc.WithInsecure(), /* allow non-TLS connections */
+		)
+		if err != nil {
+			return err
+		}
+		s.backends = append(s.backends, &backend{
+			addr:   addr,
+			conn:   conn,
+			client: hashpb.NewHashSvcClient(conn),
+		})
+	}
+
+	s.sched, err = newScheduler(s.conf.Scheduler, s.backends)
+	if err != nil {
+		return err
+	}
+
+	ctx, s.stop = context.WithCancel(ctx)
+
+	s.l, err = net.Listen("tcp", s.conf.ListenAddr)
+	if err != nil {
+		return err
+	}
+
+	srv := grpc.NewServer()
+	parhashpb.RegisterParallelHashSvcServer(srv, s)
+
+	s.wg.Add(2)
+	go func() {
+		defer s.wg.Done()
+
+		srv.Serve(s.l)
+	}()
+	go func() {
+		defer s.wg.Done()
+
+		<-ctx.Done()
+		s.l.Close()
+	}()
 
 	return nil
 }
 
 func (s *Server) ListenAddr() string {
-	/* implement me */
-	return ""
+	return s.l.Addr().String()
 }
 
 func (s *Server) Stop() {
-	/* implement me */
+	s.stop()
+	s.wg.Wait()
+	s.closeBackends()
+}
+
+func (s *Server) closeBackends() {
+	for _, b := range s.backends {
+		b.conn.Close()
+	}
+	s.backends = nil
+}
+
+func (s *Server) ParallelHash(ctx context.Context, req *parhashpb.ParHashReq) (resp *parhashpb.ParHashResp, err error) {
+	var (
+		wg     = workgroup.New(workgroup.Config{Sem: s.sem})
+		hashes = make([][]byte, len(req.Data))
+	)
+	for i := range req.Data {
+		i := i
+
+		wg.Go(ctx, func(ctx context.Context) (err error) {
+			hashes[i], err = s.hash(ctx, req.Data[i])
+			return err
+		})
+	}
+	if err := wg.Wait(); err != nil {
+		return nil, err
+	}
+
+	return &parhashpb.ParHashResp{Hashes: hashes}, nil
+}
+
+// ParallelHashStream hashes buffers as they arrive. Every buffer is hashed by
+// its own goroutine within a workgroup, as in ParallelHash(), and its hash is
+// sent back by a single sender goroutine, so that a client that is slow to
+// read does not hold slots of Server.sem while Send() waits for it. At most
+// 2 * Concurrency buffers of a stream may be in flight or waiting to be sent,
+// so that neither a client that sends faster than backends hash nor one that
+// reads slower makes the server buffer the whole stream in memory.
+func (s *Server) ParallelHashStream(stream parhashpb.ParallelHashSvc_ParallelHashStreamServer) error {
+	ctx, cancel := context.WithCancel(stream.Context())
+	defer cancel()
+
+	window := 2 * s.conf.Concurrency
+	hs := &hashStream{
+		stream:  stream,
+		cancel:  cancel,
+		wg:      workgroup.New(workgroup.Config{Sem: s.sem}),
+		window:  semaphore.NewWeighted(int64(window)),
+		results: make(chan *parhashpb.ParHashStreamResp, window),
+	}
+
+	// Recv() does not watch ctx, so buffers are received by a goroutine
+	// of their own: a failed subquery ends the call right away, even
+	// if the client has nothing more to send, and returning from here
+	// tears the stream down and unblocks the receiver.
+	received := make(chan error, 1)
+	go func() {
+		received <- s.receive(ctx, hs)
+	}()
+
+	sent := make(chan struct{})
+	go func() {
+		defer close(sent)
+
+		hs.sendResults(ctx)
+	}()
+
+	select {
+	case err := <-received:
+		if err == nil {
+			// All buffers have been dispatched, the workgroup
+			// cannot grow anymore.
+			err = hs.wg.Wait()
+		}
+		if err == nil {
+			close(hs.results)
+		} else {
+			hs.fail(err)
+		}
+	case <-ctx.Done():
+	}
+
+	// Send() must not be called once the handler has returned.
+	<-sent
+	return hs.result(ctx)
+}
+
+// hashStream is the state of a ParallelHashStream() call.
+type hashStream struct {
+	stream parhashpb.ParallelHashSvc_ParallelHashStreamServer
+	cancel context.CancelFunc
+
+	wg *workgroup.Wg
+
+	// A buffer takes a slot of @window before it is dispatched, and
+	// gives it back once its hash is sent, so @results never has
+	// more than cap(@results) hashes and never blocks a workgroup
+	// goroutine.
+	window  *semaphore.Weighted
+	results chan *parhashpb.ParHashStreamResp
+
+	lock sync.Mutex
+	err  error
+}
+
+// receive dispatches buffers until the client closes its side of the stream.
+func (s *Server) receive(ctx context.Context, hs *hashStream) error {
+	for index := uint64(0); ; {
+		req, err := hs.stream.Recv()
+		if err == io.EOF {
+			return nil
+		}
+		if err != nil {
+			return err
+		}
+
+		for _, data := range req.Data {
+			if err := hs.window.Acquire(ctx, 1); err != nil {
+				return err
+			}
+
+			i, data := index, data
+			index++
+
+			hs.wg.Go(ctx, func(ctx context.Context) error {
+				hash, err := s.hash(ctx, data)
+				if err != nil {
+					hs.fail(err)
+					return err
+				}
+
+				hs.results <- &parhashpb.ParHashStreamResp{Index: i, Hash: hash}
+				return nil
+			})
+		}
+	}
+}
+
+// sendResults sends hashes back until @results is closed or the call fails.
+func (hs *hashStream) sendResults(ctx context.Context) {
+	for {
+		select {
+		case resp, ok := <-hs.results:
+			if !ok {
+				return
+			}
+			if err := hs.stream.Send(resp); err != nil {
+				hs.fail(err)
+				return
+			}
+			hs.window.Release(1)
+		case <-ctx.Done():
+			return
+		}
+	}
+}
+
+// fail records the first error and cancels the remaining subqueries.
+func (hs *hashStream) fail(err error) {
+	hs.lock.Lock()
+	if hs.err == nil {
+		hs.err = err
+	}
+	hs.lock.Unlock()
+
+	hs.cancel()
+}
+
+// result returns the first error of the call, or the error of @ctx if the
+// client went away.
+func (hs *hashStream) result(ctx context.Context) error {
+	hs.lock.Lock()
+	defer hs.lock.Unlock()
+
+	if hs.err != nil {
+		return hs.err
+	}
+	return ctx.Err()
+}
+
+// hash computes the hash of @data on one of the backends. If the scheduler
+// hedges and the backend does not answer within its recent p99 latency, the
+// same subquery is also sent to another backend, provided that the
+// concurrency limit allows one more subquery, and the first answer wins.
+func (s *Server) hash(ctx context.Context, data []byte) ([]byte, error) {
+	b := s.sched.pick(nil)
+	if b == nil {
+		return nil, errors.New("no backends")
+	}
+
+	delay, ok := b.lat.quantile(hedgeQuantile)
+	if !s.sched.hedge() || !ok {
+		return s.subquery(ctx, b, data)
+	}
+
+	hctx, cancel := context.WithCancel(ctx)
+	defer cancel()
+
+	type result struct {
+		b    *backend
+		hash []byte
+		err  error
+	}
+	results := make(chan result, 2)
+	issue := func(b *backend, release bool) {
+		go func() {
+			if release {
+				defer s.sem.Release(1)
+			}
+
+			hash, err := s.subquery(hctx, b, data)
+			results <- result{b, hash, err}
+		}()
+	}
+	start := time.Now()
+	issue(b, false)
+
+	timer := time.NewTimer(delay)
+	defer timer.Stop()
+
+	var err error
+	for pending := 1; pending > 0; {
+		select {
+		case r := <-results:
+			if r.err == nil {
+				if r.b != b && pending > 1 {
+					// The hedge beat the primary, which is
+					// still running: its elapsed time is a lower
+					// bound of its latency, and keeps it from
+					// being picked again while it is slow.
+					b.lat.observe(time.Since(start))
+				}
+				return r.hash, nil
+			}
+			err = r.err
+			pending--
+		case <-timer.C:
+			alt := s.sched.pick(b)
+			if alt != nil && s.sem.TryAcquire(1) {
+				issue(alt, true)
+				pending++
+			}
+		}
+	}
+	return nil, err
+}
+
+// subquery asks backend @b for the hash of @data within @ctx, which may be
+// cancelled early if another backend answers first.
+func (s *Server) subquery(ctx context.Context, b *backend, data []byte) ([]byte, error) {
+	b.inflight.Add(1)
+	defer b.inflight.Add(-1)
+
+	start := time.Now()
+	resp, err := b.client.Hash(ctx, &hashpb.HashReq{Data: data})
+	if err == nil || ctx.Err() == nil {
+		// Only subqueries that finished on their own tell
+		// the latency of the backend, cancelled ones do not.
+		b.lat.observe(time.Since(start))
+	}
+	if err != nil {
+		return nil, errors.Wrapf(err, "backend %s", b.addr)
+	}
+	return resp.Hash, nil
 }
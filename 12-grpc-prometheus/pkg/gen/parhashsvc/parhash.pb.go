@@ -114,6 +114,108 @@ func (x *ParHashResp) GetHashes() [][]byte {
 	return nil
 }
 
+type ParHashStreamReq struct {
+	state         protoimpl.MessageState
+	sizeCache     protoimpl.SizeCache
+	unknownFields protoimpl.UnknownFields
+
+	Data [][]byte `protobuf:"bytes,1,rep,name=data,proto3" json:"data,omitempty"`
+}
+
+func (x *ParHashStreamReq) Reset() {
+	*x = ParHashStreamReq{}
+	if protoimpl.UnsafeEnabled {
+		mi := &file_parhash_proto_msgTypes[2]
+		ms := protoimpl.X.MessageStateOf(protoimpl.Pointer(x))
+		ms.StoreMessageInfo(mi)
+	}
+}
+
+func (x *ParHashStreamReq) String() string {
+	return protoimpl.X.MessageStringOf(x)
+}
+
+func (*ParHashStreamReq) ProtoMessage() {}
+
+func (x *ParHashStreamReq) ProtoReflect() protoreflect.Message {
+	mi := &file_parhash_proto_msgTypes[2]
+	if protoimpl.UnsafeEnabled && x != nil {
+		ms := protoimpl.X.MessageStateOf(protoimpl.Pointer(x))
+		if ms.LoadMessageInfo() == nil {
+			ms.StoreMessageInfo(mi)
+		}
+		return ms
+	}
+	return mi.MessageOf(x)
+}
+
+// Deprecated: Use ParHashStreamReq.ProtoReflect.Descriptor instead.
+func (*ParHashStreamReq) Descriptor() ([]byte, []int) {
+	return file_parhash_proto_rawDescGZIP(), []int{2}
+}
+
+func (x *ParHashStreamReq) GetData() [][]byte {
+	if x != nil {
+		return x.Data
+	}
+	return nil
+}
+
+type ParHashStreamResp struct {
+	state         protoimpl.MessageState
+	sizeCache     protoimpl.SizeCache
+	unknownFields protoimpl.UnknownFields
+
+	Index uint64 `protobuf:"varint,1,opt,name=index,proto3" json:"index,omitempty"`
+	Hash  []byte `protobuf:"bytes,2,opt,name=hash,proto3" json:"hash,omitempty"`
+}
+
+func (x *ParHashStreamResp) Reset() {
+	*x = ParHashStreamResp{}
+	if protoimpl.UnsafeEnabled {
+		mi := &file_parhash_proto_msgTypes[3]
+		ms := protoimpl.X.MessageStateOf(protoimpl.Pointer(x))
+		ms.StoreMessageInfo(mi)
+	}
+}
+
+func (x *ParHashStreamResp) String() string {
+	return protoimpl.X.MessageStringOf(x)
+}
+
+func (*ParHashStreamResp) ProtoMessage() {}
+
+func (x *ParHashStreamResp) ProtoReflect() protoreflect.Message {
+	mi := &file_parhash_proto_msgTypes[3]
+	if protoimpl.UnsafeEnabled && x != nil {
+		ms := protoimpl.X.MessageStateOf(protoimpl.Pointer(x))
+		if ms.LoadMessageInfo() == nil {
+			ms.StoreMessageInfo(mi)
+		}
+		return ms
+	}
+	return mi.MessageOf(x)
+}
+
+// Deprecated: Use ParHashStreamResp.ProtoReflect.Descriptor instead.
+func (*ParHashStreamResp) Descriptor() ([]byte, []int) {
+	return file_parhash_proto_rawDescGZIP(), []int{3}
+}
+
+func (x *ParHashStreamResp) GetIndex() uint64 {
+	if x != nil {
+		return x.Index
+	}
+	return 0
+}
+
+func (x *ParHashStreamResp) GetHash() []byte {
+	if x != nil {
+		return x.Hash
+	}
+	return nil
+}
+
 var File_parhash_proto protoreflect.FileDescriptor
 
 var file_parhash_proto_rawDesc = []byte{
@@ -123,15 +225,27 @@ var file_parhash_proto_rawDesc = []byte{
 	0x61, 0x18, 0x01, 0x20, 0x03, 0x28, 0x0c, 0x52, 0x04, 0x64, 0x61, 0x74, 0x61, 0x22, 0x25, 0x0a,
 	0x0b, 0x50, 0x61, 0x72, 0x48, 0x61, 0x73, 0x68, 0x52, 0x65, 0x73, 0x70, 0x12, 0x16, 0x0a, 0x06,
 	0x68, 0x61, 0x73, 0x68, 0x65, 0x73, 0x18, 0x01, 0x20, 0x03, 0x28, 0x0c, 0x52, 0x06, 0x68, 0x61,
-	0x73, 0x68, 0x65, 0x73, 0x32, 0x52, 0x0a, 0x0f, 0x50, 0x61, 0x72, 0x61, 0x6c, 0x6c, 0x65, 0x6c,
-	0x48, 0x61, 0x73, 0x68, 0x53, 0x76, 0x63, 0x12, 0x3f, 0x0a, 0x0c, 0x50, 0x61, 0x72, 0x61, 0x6c,
-	0x6c, 0x65, 0x6c, 0x48, 0x61, 0x73, 0x68, 0x12, 0x16, 0x2e, 0x70, 0x61, 0x72, 0x68, 0x61, 0x73,
-	0x68, 0x73, 0x76, 0x63, 0x2e, 0x50, 0x61, 0x72, 0x48, 0x61, 0x73, 0x68, 0x52, 0x65, 0x71, 0x1a,
-	0x17, 0x2e, 0x70, 0x61, 0x72, 0x68, 0x61, 0x73, 0x68, 0x73, 0x76, 0x63, 0x2e, 0x50, 0x61, 0x72,
-	0x48, 0x61, 0x73, 0x68, 0x52, 0x65, 0x73, 0x70, 0x42, 0x27, 0x5a, 0x25, 0x31, 0x31, 0x2d, 0x67,
-	0x72, 0x70, 0x63, 0x2f, 0x70, 0x6b, 0x67, 0x2f, 0x67, 0x65, 0x6e, 0x2f, 0x70, 0x61, 0x72, 0x68,
-	0x61, 0x73, 0x68, 0x73, 0x76, 0x63, 0x3b, 0x70, 0x61, 0x72, 0x68, 0x61, 0x73, 0x68, 0x73, 0x76,
-	0x63, 0x62, 0x06, 0x70, 0x72, 0x6f, 0x74, 0x6f, 0x33,
+	0x73, 0x68, 0x65, 0x73, 0x22, 0x26, 0x0a, 0x10, 0x50, 0x61, 0x72, 0x48, 0x61, 0x73, 0x68, 0x53,
+	0x74, 0x72, 0x65, 0x61, 0x6d, 0x52, 0x65, 0x71, 0x12, 0x12, 0x0a, 0x04, 0x64, 0x61, 0x74, 0x61,
+	0x18, 0x01, 0x20, 0x03, 0x28, 0x0c, 0x52, 0x04, 0x64, 0x61, 0x74, 0x61, 0x22, 0x3d, 0x0a, 0x11,
+	0x50, 0x61, 0x72, 0x48, 0x61, 0x73, 0x68, 0x53, 0x74, 0x72, 0x65, 0x61, 0x6d, 0x52, 0x65, 0x73,
+	0x70, 0x12, 0x14, 0x0a, 0x05, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x18, 0x01, 0x20, 0x01, 0x28, 0x04,
+	0x52, 0x05, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x12, 0x12, 0x0a, 0x04, 0x68, 0x61, 0x73, 0x68, 0x18,
+	0x02, 0x20, 0x01, 0x28, 0x0c, 0x52, 0x04, 0x68, 0x61, 0x73, 0x68, 0x32, 0xa9, 0x01, 0x0a, 0x0f,
+	0x50, 0x61, 0x72, 0x61, 0x6c, 0x6c, 0x65, 0x6c, 0x48, 0x61, 0x73, 0x68, 0x53, 0x76, 0x63, 0x12,
+	0x3f, 0x0a, 0x0c, 0x50, 0x61, 0x72, 0x61, 0x6c, 0x6c, 0x65, 0x6c, 0x48, 0x61, 0x73, 0x68, 0x12,
+	0x16, 0x2e, 0x70, 0x61, 0x72, 0x68, 0x61, 0x73, 0x68, 0x73, 0x76, 0x63, 0x2e, 0x50, 0x61, 0x72,
+	0x48, 0x61, 0x73, 0x68, 0x52, 0x65, 0x71, 0x1a, 0x17, 0x2e, 0x70, 0x61, 0x72, 0x68, 0x61, 0x73,
+	0x68, 0x73, 0x76, 0x63, 0x2e, 0x50, 0x61, 0x72, 0x48, 0x61, 0x73, 0x68, 0x52, 0x65, 0x73, 0x70,
+	0x12, 0x55, 0x0a, 0x12, 0x50, 0x61, 0x72, 0x61, 0x6c, 0x6c, 0x65, 0x6c, 0x48, 0x61, 0x73, 0x68,
+	0x53, 0x74, 0x72, 0x65, 0x61, 0x6d, 0x12, 0x1c, 0x2e, 0x70, 0x61, 0x72, 0x68, 0x61, 0x73, 0x68,
+	0x73, 0x76, 0x63, 0x2e, 0x50, 0x61, 0x72, 0x48, 0x61, 0x73, 0x68, 0x53, 0x74, 0x72, 0x65, 0x61,
+	0x6d, 0x52, 0x65, 0x71, 0x1a, 0x1d, 0x2e, 0x70, 0x61, 0x72, 0x68, 0x61, 0x73, 0x68, 0x73, 0x76,
+	0x63, 0x2e, 0x50, 0x61, 0x72, 0x48, 0x61, 0x73, 0x68, 0x53, 0x74, 0x72, 0x65, 0x61, 0x6d, 0x52,
+	0x65, 0x73, 0x70, 0x28, 0x01, 0x30, 0x01, 0x42, 0x27, 0x5a, 0x25, 0x31, 0x31, 0x2d, 0x67, 0x72,
+	0x70, 0x63, 0x2f, 0x70, 0x6b, 0x67, 0x2f, 0x67, 0x65, 0x6e, 0x2f, 0x70, 0x61, 0x72, 0x68, 0x61,
+	0x73, 0x68, 0x73, 0x76, 0x63, 0x3b, 0x70, 0x61, 0x72, 0x68, 0x61, 0x73, 0x68, 0x73, 0x76, 0x63,
+	0x62, 0x06, 0x70, 0x72, 0x6f, 0x74, 0x6f, 0x33,
 }
 
 var (
@@ -146,16 +260,20 @@ func file_parhash_proto_rawDescGZIP() []byte {
 	return file_parhash_proto_rawDescData
 }
 
-var file_parhash_proto_msgTypes = make([]protoimpl.MessageInfo, 2)
+var file_parhash_proto_msgTypes = make([]protoimpl.MessageInfo, 4)
 var file_parhash_proto_goTypes = []interface{}{
-	(*ParHashReq)(nil),  // 0: parhashsvc.ParHashReq
-	(*ParHashResp)(nil), // 1: parhashsvc.ParHashResp
+	(*ParHashReq)(nil),        // 0: parhashsvc.ParHashReq
+	(*ParHashResp)(nil),       // 1: parhashsvc.ParHashResp
+	(*ParHashStreamReq)(nil),  // 2: parhashsvc.ParHashStreamReq
+	(*ParHashStreamResp)(nil), // 3: parhashsvc.ParHashStreamResp
 }
 var file_parhash_proto_depIdxs = []int32{
 	0, // 0: parhashsvc.ParallelHashSvc.ParallelHash:input_type -> parhashsvc.ParHashReq
-	1, // 1: parhashsvc.ParallelHashSvc.ParallelHash:output_type -> parhashsvc.ParHashResp
-	1, // [1:2] is the sub-list for method output_type
-	0, // [0:1] is the sub-list for method input_type
+	2, // 1: parhashsvc.ParallelHashSvc.ParallelHashStream:input_type -> parhashsvc.ParHashStreamReq
+	1, // 2: parhashsvc.ParallelHashSvc.ParallelHash:output_type -> parhashsvc.ParHashResp
+	3, // 3: parhashsvc.ParallelHashSvc.ParallelHashStream:output_type -> parhashsvc.ParHashStreamResp
+	2, // [2:4] is the sub-list for method output_type
+	0, // [0:2] is the sub-list for method input_type
 	0, // [0:0] is the sub-list for extension type_name
 	0, // [0:0] is the sub-list for extension extendee
 	0, // [0:0] is the sub-list for field type_name
@@ -191,6 +309,30 @@ func file_parhash_proto_init() {
 				return nil
 			}
 		}
+		file_parhash_proto_msgTypes[2].Exporter = func(v interface{}, i int) interface{} {
+			switch v := v.(*ParHashStreamReq); i {
+			case 0:
+				return &v.state
+			case 1:
+				return &v.sizeCache
+			case 2:
+				return &v.unknownFields
+			default:
+				return nil
+			}
+		}
+		file_parhash_proto_msgTypes[3].Exporter = func(v interface{}, i int) interface{} {
+			switch v := v.(*ParHashStreamResp); i {
+			case 0:
+				return &v.state
+			case 1:
+				return &v.sizeCache
+			case 2:
+				return &v.unknownFields
+			default:
+				return nil
+			}
+		}
 	}
 	type x struct{}
 	out := protoimpl.TypeBuilder{
@@ -198,7 +340,7 @@ func file_parhash_proto_init() {
 			GoPackagePath: reflect.TypeOf(x{}).PkgPath(),
 			RawDescriptor: file_parhash_proto_rawDesc,
 			NumEnums:      0,
-			NumMessages:   2,
+			NumMessages:   4,
 			NumExtensions: 0,
 			NumServices:   1,
 		},
@@ -23,6 +23,10 @@ const _ = grpc.SupportPackageIsVersion7
 // For semantics around ctx use and closing/ending streaming RPCs, please refer to https://pkg.go.dev/google.golang.org/grpc/?tab=doc#ClientConn.NewStream.
 type ParallelHashSvcClient interface {
 	ParallelHash(ctx context.Context, in *ParHashReq, opts ...grpc.CallOption) (*ParHashResp, error)
+	// Hashes buffers as they arrive: buffers are numbered in the order
+	// they are sent, across all messages of the stream, and each hash
+	// is sent back with the index of its buffer as soon as it is ready.
+	ParallelHashStream(ctx context.Context, opts ...grpc.CallOption) (ParallelHashSvc_ParallelHashStreamClient, error)
 }
 
 type parallelHashSvcClient struct {
@@ -42,11 +46,46 @@ func (c *parallelHashSvcClient) ParallelHash(ctx context.Context, in *ParHashReq
 	return out, nil
 }
 
+func (c *parallelHashSvcClient) ParallelHashStream(ctx context.Context, opts ...grpc.CallOption) (ParallelHashSvc_ParallelHashStreamClient, error) {
+	stream, err := c.cc.NewStream(ctx, &ParallelHashSvc_ServiceDesc.Streams[0], "/parhashsvc.ParallelHashSvc/ParallelHashStream", opts...)
+	if err != nil {
+		return nil, err
+	}
+	x := &parallelHashSvcParallelHashStreamClient{stream}
+	return x, nil
+}
+
+type ParallelHashSvc_ParallelHashStreamClient interface {
+	Send(*ParHashStreamReq) error
+	Recv() (*ParHashStreamResp, error)
+	grpc.ClientStream
+}
+
+type parallelHashSvcParallelHashStreamClient struct {
+	grpc.ClientStream
+}
+
+func (x *parallelHashSvcParallelHashStreamClient) Send(m *ParHashStreamReq) error {
+	return x.ClientStream.SendMsg(m)
+}
+
+func (x *parallelHashSvcParallelHashStreamClient) Recv() (*ParHashStreamResp, error) {
+	m := new(ParHashStreamResp)
+	if err := x.ClientStream.RecvMsg(m); err != nil {
+		return nil, err
+	}
+	return m, nil
+}
+
 // ParallelHashSvcServer is the server API for ParallelHashSvc service.
 // All implementations should embed UnimplementedParallelHashSvcServer
 // for forward compatibility
 type ParallelHashSvcServer interface {
 	ParallelHash(context.Context, *ParHashReq) (*ParHashResp, error)
+	// Hashes buffers as they arrive: buffers are numbered in the order
+	// they are sent, across all messages of the stream, and each hash
+	// is sent back with the index of its buffer as soon as it is ready.
+	ParallelHashStream(ParallelHashSvc_ParallelHashStreamServer) error
 }
 
 // UnimplementedParallelHashSvcServer should be embedded to have forward compatible implementations.
@@ -56,6 +95,9 @@ type UnimplementedParallelHashSvcServer struct {
 func (UnimplementedParallelHashSvcServer) ParallelHash(context.Context, *ParHashReq) (*ParHashResp, error) {
 	return nil, status.Errorf(codes.Unimplemented, "method ParallelHash not implemented")
 }
+func (UnimplementedParallelHashSvcServer) ParallelHashStream(ParallelHashSvc_ParallelHashStreamServer) error {
+	return status.Errorf(codes.Unimplemented, "method ParallelHashStream not implemented")
+}
 
 // UnsafeParallelHashSvcServer may be embedded to opt out of forward compatibility for this service.
 // Use of this interface is not recommended, as added methods to ParallelHashSvcServer will
@@ -86,6 +128,32 @@ func _ParallelHashSvc_ParallelHash_Handler(srv interface{}, ctx context.Context,
 	return interceptor(ctx, in, info, handler)
 }
 
+func _ParallelHashSvc_ParallelHashStream_Handler(srv interface{}, stream grpc.ServerStream) error {
+	return srv.(ParallelHashSvcServer).ParallelHashStream(&parallelHashSvcParallelHashStreamServer{stream})
+}
+
+type ParallelHashSvc_ParallelHashStreamServer interface {
+	Send(*ParHashStreamResp) error
+	Recv() (*ParHashStreamReq, error)
+	grpc.ServerStream
+}
+
+type parallelHashSvcParallelHashStreamServer struct {
+	grpc.ServerStream
+}
+
+func (x *parallelHashSvcParallelHashStreamServer) Send(m *ParHashStreamResp) error {
+	return x.ServerStream.SendMsg(m)
+}
+
+func (x *parallelHashSvcParallelHashStreamServer) Recv() (*ParHashStreamReq, error) {
+	m := new(ParHashStreamReq)
+	if err := x.ServerStream.RecvMsg(m); err != nil {
+		return nil, err
+	}
+	return m, nil
+}
+
 // ParallelHashSvc_ServiceDesc is the grpc.ServiceDesc for ParallelHashSvc service.
 // It's only intended for direct use with grpc.RegisterService,
 // and not to be introspected or modified (even as a copy)
@@ -98,6 +166,13 @@ var ParallelHashSvc_ServiceDesc = grpc.ServiceDesc{
 			Handler:    _ParallelHashSvc_ParallelHash_Handler,
 		},
 	},
-	Streams:  []grpc.StreamDesc{},
+	Streams: []grpc.StreamDesc{
+		{
+			StreamName:    "ParallelHashStream",
+			Handler:       _ParallelHashSvc_ParallelHashStream_Handler,
+			ServerStreams: true,
+			ClientStreams: true,
+		},
+	},
 	Metadata: "parhash.proto",
 }
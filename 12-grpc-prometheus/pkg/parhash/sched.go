@@ -0,0 +1,235 @@
+package parhash
+
+import (
+	"math"
+	"sync"
+	"sync/atomic"
+	"time"
+
+	"github.com/pkg/errors"
+	"google.golang.org/grpc"
+
+	hashpb "fs101ex/pkg/gen/hashsvc"
+)
+
+// Schedulers that assign buffers to backends.
+const (
+	// Each buffer goes to the next backend in turn.
+	SchedRoundRobin = "round-robin"
+
+	// Each buffer goes to the backend with the fewest in-flight
+	// subqueries, weighted by its recent latency, and subqueries that
+	// run longer than the p99 latency of their backend are hedged
+	// to another backend.
+	SchedLeastOutstanding = "least-outstanding"
+)
+
+const (
+	// The quantile of recent latencies past which a subquery is hedged.
+	hedgeQuantile = 0.99
+
+	// Quantiles are not trusted until a backend has this many samples.
+	minLatencySamples = 100
+
+	// Latency samples are halved every time there are this many of
+	// them, so that old samples fade out.
+	latencyWindow = 1000
+)
+
+// latencyBuckets are upper bounds of latency buckets, the same as those
+// of subquery_durations: 24 exponentially growing buckets from 0.1ms to 10s.
+var latencyBuckets = expBuckets(100*time.Microsecond, 10*time.Second, 24)
+
+func expBuckets(min, max time.Duration, n int) []time.Duration {
+	factor := math.Pow(float64(max)/float64(min), 1/float64(n-1))
+	buckets := make([]time.Duration, n)
+	for i := range buckets {
+		buckets[i] = time.Duration(float64(min) * math.Pow(factor, float64(i)))
+	}
+	buckets[n-1] = max
+	return buckets
+}
+
+// latency tracks recent subquery durations of a backend.
+type latency struct {
+	lock sync.Mutex
+
+	// counts[i] is the number of samples in latencyBuckets[i],
+	// the last one counts samples above all buckets.
+	counts []float64
+	total  float64
+
+	// An exponentially weighted moving average, 0 if there are
+	// no samples yet.
+	avg time.Duration
+}
+
+func (l *latency) observe(d time.Duration) {
+	l.lock.Lock()
+	defer l.lock.Unlock()
+
+	if l.counts == nil {
+		l.counts = make([]float64, len(latencyBuckets)+1)
+	}
+
+	i := 0
+	for i < len(latencyBuckets) && d > latencyBuckets[i] {
+		i++
+	}
+	l.counts[i]++
+	l.total++
+
+	if l.total >= latencyWindow {
+		for i := range l.counts {
+			l.counts[i] /= 2
+		}
+		l.total /= 2
+	}
+
+	if l.avg == 0 {
+		l.avg = d
+	} else {
+		l.avg += (d - l.avg) / 8
+	}
+}
+
+func (l *latency) mean() time.Duration {
+	l.lock.Lock()
+	defer l.lock.Unlock()
+
+	return l.avg
+}
+
+// quantile returns the upper bound of the bucket that holds the q-th
+// quantile, and false if there are too few samples to tell.
+func (l *latency) quantile(q float64) (time.Duration, bool) {
+	l.lock.Lock()
+	defer l.lock.Unlock()
+
+	if l.total < minLatencySamples {
+		return 0, false
+	}
+
+	want := q * l.total
+	seen := 0.0
+	for i, bound := range latencyBuckets {
+		seen += l.counts[i]
+		if seen >= want {
+			return bound, true
+		}
+	}
+	return latencyBuckets[len(latencyBuckets)-1], true
+}
+
+type backend struct {
+	addr   string
+	conn   *grpc.ClientConn
+	client hashpb.HashSvcClient
+
+	inflight atomic.Int64
+	lat      latency
+}
+
+// scheduler picks backends for subqueries.
+type scheduler interface {
+	// pick returns a backend other than @exclude, or nil if there is none.
+	// @exclude may be nil.
+	pick(exclude *backend) *backend
+
+	// hedge reports whether slow subqueries should be hedged.
+	hedge() bool
+}
+
+func newScheduler(name string, backends []*backend) (scheduler, error) {
+	switch name {
+	case "", SchedRoundRobin:
+		return &roundRobin{backends: backends}, nil
+	case SchedLeastOutstanding:
+		return &leastOutstanding{backends: backends}, nil
+	default:
+		return nil, errors.Errorf("unknown scheduler %q", name)
+	}
+}
+
+type roundRobin struct {
+	backends []*backend
+	next     atomic.Uint64
+}
+
+func (s *roundRobin) pick(exclude *backend) *backend {
+	n := uint64(len(s.backends))
+	if n == 0 || n == 1 && s.backends[0] == exclude {
+		return nil
+	}
+
+	for {
+		b := s.backends[(s.next.Add(1)-1)%n]
+		if b != exclude {
+			return b
+		}
+	}
+}
+
+func (s *roundRobin) hedge() bool {
+	return false
+}
+
+type leastOutstanding struct {
+	backends []*backend
+
+	// Rotates the starting point of the search, so that ties are
+	// broken evenly.
+	next atomic.Uint64
+}
+
+// pick returns the backend that is expected to finish a new subquery first,
+// that is the one with the smallest (in-flight + 1) * mean latency.
+// Backends without samples are assumed to be as fast as an average backend.
+func (s *leastOutstanding) pick(exclude *backend) *backend {
+	n := len(s.backends)
+	if n == 0 {
+		return nil
+	}
+
+	means := make([]time.Duration, n)
+	var sum time.Duration
+	nrKnown := 0
+	for i, b := range s.backends {
+		means[i] = b.lat.mean()
+		if means[i] > 0 {
+			sum += means[i]
+			nrKnown++
+		}
+	}
+	fallback := time.Duration(1)
+	if nrKnown > 0 {
+		fallback = sum / time.Duration(nrKnown)
+	}
+
+	var (
+		best      *backend
+		bestScore float64
+	)
+	start := int(s.next.Add(1) % uint64(n))
+	for k := 0; k < n; k++ {
+		i := (start + k) % n
+		b := s.backends[i]
+		if b == exclude {
+			continue
+		}
+
+		mean := means[i]
+		if mean == 0 {
+			mean = fallback
+		}
+		score := float64(b.inflight.Load()+1) * float64(mean)
+		if best == nil || score < bestScore {
+			best, bestScore = b, score
+		}
+	}
+	return best
+}
+
+func (s *leastOutstanding) hedge() bool {
+	return true
+}
@@ -4,11 +4,14 @@
 
 int main(int argc, char **argv)
 {
-	if (argc != 2) {
-		fprintf(stderr, "use: %s <path>\n", argv[0]);
+	if (argc < 2) {
+		fprintf(stderr, "use: %s <path>...\n", argv[0]);
 		return 1;
 	}
 
-	abspath(argv[1]);
+	if (argc == 2)
+		abspath(argv[1]);
+	else
+		abspath_many((const char *const *)argv + 1, argc - 1, NULL);
 	return 0;
 }
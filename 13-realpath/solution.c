@@ -1,8 +1,414 @@
 #include <solution.h>
+#include <fs_malloc.h>
+#include <fs_string.h>
+
+#include <sys/stat.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+
+/* The same limit as Linux uses for path walks. */
+#define MAX_SYMLINKS 40
+
+static void buf_set(struct fs_strbuf *b, const char *s, size_t len)
+{
+	fs_strbuf_clear(b);
+	fs_strbuf_append(b, s, len);
+}
+
+/*
+   The result of looking up a child @name of a resolved directory
+   @parent. The root directory has no dentry, so its children have
+   @parent set to NULL.
+ */
+struct dentry
+{
+	struct dentry *next;
+	const struct dentry *parent;
+	uint64_t hash;
+	int err;
+	mode_t type;
+	char *target;
+	size_t name_len;
+	char name[];
+};
+
+struct abspath_cache
+{
+	/* Dentries and symlink targets, freed all at once. */
+	struct fs_arena arena;
+
+	struct dentry **buckets;
+	size_t nr_buckets;
+	size_t nr_entries;
+};
+
+static uint64_t hash_name(const struct dentry *parent, const char *name, size_t len)
+{
+	/* FNV-1a, seeded with the parent's identity */
+	uint64_t h = 0xcbf29ce484222325ULL ^ (uint64_t)(uintptr_t)parent;
+	for (size_t i = 0; i < len; ++i) {
+		h ^= (unsigned char)name[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+int abspath_cache_init(struct abspath_cache **c)
+{
+	struct abspath_cache *x = fs_xzalloc(sizeof(*x));
+	fs_arena_init(&x->arena, 0);
+	x->nr_buckets = 256;
+	x->buckets = fs_xzalloc(x->nr_buckets * sizeof(x->buckets[0]));
+	*c = x;
+	return 0;
+}
+
+void abspath_cache_free(struct abspath_cache *c)
+{
+	if (c == NULL)
+		return;
+
+	fs_arena_release(&c->arena);
+	fs_xfree(c->buckets);
+	fs_xfree(c);
+}
+
+static struct dentry* cache_find(struct abspath_cache *c, const struct dentry *parent,
+				 const char *name, size_t len, uint64_t hash)
+{
+	struct dentry *d = c->buckets[hash & (c->nr_buckets - 1)];
+	for (; d; d = d->next) {
+		if (d->hash == hash && d->parent == parent &&
+		    d->name_len == len && memcmp(d->name, name, len) == 0)
+			return d;
+	}
+	return NULL;
+}
+
+static void cache_grow(struct abspath_cache *c)
+{
+	size_t nr_buckets = c->nr_buckets * 2;
+	struct dentry **buckets = fs_xzalloc(nr_buckets * sizeof(buckets[0]));
+
+	for (size_t i = 0; i < c->nr_buckets; ++i) {
+		struct dentry *d = c->buckets[i];
+		while (d) {
+			struct dentry *next = d->next;
+			size_t j = d->hash & (nr_buckets - 1);
+			d->next = buckets[j];
+			buckets[j] = d;
+			d = next;
+		}
+	}
+
+	fs_xfree(c->buckets);
+	c->buckets = buckets;
+	c->nr_buckets = nr_buckets;
+}
+
+static void cache_insert(struct abspath_cache *c, struct dentry *d)
+{
+	if (c->nr_entries >= c->nr_buckets)
+		cache_grow(c);
+
+	size_t i = d->hash & (c->nr_buckets - 1);
+	d->next = c->buckets[i];
+	c->buckets[i] = d;
+	c->nr_entries++;
+}
+
+/* A directory on the resolved path, starting with the root. */
+struct level
+{
+	const struct dentry *d;
+	/* The length of the resolved path up to and including
+	   the directory's trailing '/'. */
+	size_t len;
+};
+
+/*
+   The walker keeps the resolved path of the current directory in @dir
+   and an O_PATH descriptor @fd of one of its ancestors (or itself),
+   at depth @fd_depth. Lookups are relative to @fd, so the kernel never
+   re-walks the prefix of the path. The descriptor catches up with
+   @dir lazily, only when a lookup misses the cache.
+ */
+struct walker
+{
+	struct abspath_cache *cache;
+
+	/* The resolved path of the current directory. It always ends
+	   with '/'. */
+	struct fs_strbuf dir;
+	struct level *levels;
+	size_t depth;
+	size_t max_depth;
+
+	int root;
+	int fd;
+	size_t fd_depth;
+
+	/* Components that are yet to be walked. */
+	struct fs_strbuf todo;
+	struct fs_strbuf scratch;
+	struct fs_strbuf link;
+
+	/* Holds the last lookup result if there is no cache. */
+	struct fs_arena arena;
+};
+
+static void walker_init(struct walker *w, struct abspath_cache *c)
+{
+	memset(w, 0, sizeof(*w));
+	w->cache = c;
+	fs_arena_init(&w->arena, 4096);
+
+	w->root = open("/", O_PATH | O_DIRECTORY | O_CLOEXEC);
+	if (w->root < 0)
+		err(1, "open(\"/\") failed");
+	w->fd = w->root;
+
+	w->max_depth = 16;
+	w->levels = fs_xmalloc(w->max_depth * sizeof(w->levels[0]));
+}
+
+static void walker_set_fd(struct walker *w, int fd, size_t depth)
+{
+	if (w->fd != w->root)
+		close(w->fd);
+	w->fd = fd;
+	w->fd_depth = depth;
+}
+
+static void walker_free(struct walker *w)
+{
+	walker_set_fd(w, w->root, 0);
+	close(w->root);
+
+	fs_arena_release(&w->arena);
+	fs_xfree(w->levels);
+	fs_strbuf_free(&w->link);
+	fs_strbuf_free(&w->scratch);
+	fs_strbuf_free(&w->todo);
+	fs_strbuf_free(&w->dir);
+}
+
+static void walk_root(struct walker *w)
+{
+	buf_set(&w->dir, "/", 1);
+	w->depth = 0;
+	w->levels[0] = (struct level){.d = NULL, .len = 1};
+	walker_set_fd(w, w->root, 0);
+}
+
+static void walk_down(struct walker *w, const struct dentry *d)
+{
+	fs_strbuf_append(&w->dir, d->name, d->name_len);
+	fs_strbuf_append(&w->dir, "/", 1);
+
+	if (++w->depth == w->max_depth) {
+		w->max_depth *= 2;
+		w->levels = fs_xrealloc(w->levels, w->max_depth * sizeof(w->levels[0]));
+	}
+	w->levels[w->depth] = (struct level){.d = w->cache ? d : NULL, .len = w->dir.len};
+}
+
+static void walk_up(struct walker *w)
+{
+	if (w->depth == 0)
+		return;
+
+	fs_strbuf_truncate(&w->dir, w->levels[--w->depth].len);
+	if (w->fd_depth <= w->depth)
+		return;
+
+	/* The descriptor is below the new current directory. Since
+	   the path to it is resolved, "../.." leads to where the path
+	   string does. */
+	size_t ups = w->fd_depth - w->depth;
+	buf_set(&w->scratch, "..", 2);
+	for (size_t i = 1; i < ups; ++i)
+		fs_strbuf_append(&w->scratch, "/..", 3);
+
+	int fd = openat(w->fd, w->scratch.s, O_PATH | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0)
+		walker_set_fd(w, w->root, 0);
+	else
+		walker_set_fd(w, fd, w->depth);
+}
+
+/* Return a descriptor of the current directory, or -errno. */
+static int dir_fd(struct walker *w)
+{
+	if (w->fd_depth == w->depth)
+		return w->fd;
+
+	const char *rel = w->dir.s + w->levels[w->fd_depth].len;
+	int fd = openat(w->fd, rel, O_PATH | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	walker_set_fd(w, fd, w->depth);
+	return fd;
+}
+
+static struct dentry* lookup(struct walker *w, const char *name, size_t len)
+{
+	const struct dentry *parent = w->levels[w->depth].d;
+	uint64_t hash = 0;
+	struct dentry *d = NULL;
+
+	if (w->cache) {
+		hash = hash_name(parent, name, len);
+		d = cache_find(w->cache, parent, name, len, hash);
+		if (d)
+			return d;
+	}
+
+	struct fs_arena *arena = w->cache ? &w->cache->arena : &w->arena;
+	if (w->cache == NULL)
+		fs_arena_reset(arena, (struct fs_arena_mark){0});
+
+	d = fs_arena_zalloc(arena, sizeof(*d) + len + 1);
+	d->parent = parent;
+	d->hash = hash;
+	d->name_len = len;
+	memcpy(d->name, name, len);
+
+	struct stat st;
+	int fd = dir_fd(w);
+	if (fd < 0) {
+		d->err = -fd;
+	} else if (fstatat(fd, d->name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+		d->err = errno;
+	} else {
+		d->type = st.st_mode & S_IFMT;
+		if (S_ISLNK(st.st_mode))
+			d->err = -fs_strbuf_readlinkat(&w->link, fd, d->name);
+		if (S_ISLNK(st.st_mode) && d->err == 0) {
+			d->target = fs_arena_alloc(arena, w->link.len + 1);
+			memcpy(d->target, w->link.s, w->link.len + 1);
+		}
+	}
+
+	if (w->cache)
+		cache_insert(w->cache, d);
+	return d;
+}
+
+/* Replace the first @len bytes of the todo list with @target. */
+static void splice_link(struct walker *w, size_t len, const char *target)
+{
+	buf_set(&w->scratch, target, strlen(target));
+	if (len < w->todo.len) {
+		fs_strbuf_append(&w->scratch, "/", 1);
+		fs_strbuf_append(&w->scratch, w->todo.s + len, w->todo.len - len);
+	}
+
+	struct fs_strbuf x = w->todo;
+	w->todo = w->scratch;
+	w->scratch = x;
+}
+
+static void walk(struct walker *w, const char *path)
+{
+	int nr_links = 0;
+
+	walk_root(w);
+	buf_set(&w->todo, path, strlen(path));
+
+	if (w->todo.len == 0) {
+		report_error(w->dir.s, "", ENOENT);
+		return;
+	}
+
+	size_t pos = 0;
+	for (;;) {
+		while (pos < w->todo.len && w->todo.s[pos] == '/')
+			++pos;
+		if (pos == w->todo.len)
+			break;
+
+		const char *name = w->todo.s + pos;
+		size_t len = strcspn(name, "/");
+		size_t end = pos + len;
+		bool want_dir = end < w->todo.len;
+
+		if (len == 1 && name[0] == '.') {
+			pos = end;
+			continue;
+		}
+		if (len == 2 && name[0] == '.' && name[1] == '.') {
+			walk_up(w);
+			pos = end;
+			continue;
+		}
+
+		struct dentry *d = lookup(w, name, len);
+
+		if (d->err) {
+			report_error(w->dir.s, d->name, d->err);
+			return;
+		}
+
+		if (S_ISLNK(d->type)) {
+			if (++nr_links > MAX_SYMLINKS) {
+				report_error(w->dir.s, d->name, ELOOP);
+				return;
+			}
+			if (d->target[0] == '/')
+				walk_root(w);
+			splice_link(w, end, d->target);
+			pos = 0;
+			continue;
+		}
+
+		if (S_ISDIR(d->type)) {
+			walk_down(w, d);
+			pos = end;
+			continue;
+		}
+
+		if (want_dir) {
+			report_error(w->dir.s, d->name, ENOTDIR);
+			return;
+		}
+
+		/* Build the result in place, it is discarded by the next walk. */
+		fs_strbuf_append(&w->dir, d->name, d->name_len);
+		report_path(w->dir.s);
+		return;
+	}
+
+	report_path(w->dir.s);
+}
 
 void abspath(const char *path)
 {
-	/* implement me */
+	struct walker w;
+	walker_init(&w, NULL);
+	walk(&w, path);
+	walker_free(&w);
+}
+
+void abspath_many(const char *const *paths, size_t n, struct abspath_cache *c)
+{
+	struct abspath_cache *tmp = NULL;
+	if (c == NULL) {
+		abspath_cache_init(&tmp);
+		c = tmp;
+	}
+
+	struct walker w;
+	walker_init(&w, c);
+	for (size_t i = 0; i < n; ++i)
+		walk(&w, paths[i]);
+	walker_free(&w);
 
-	(void) path;
+	abspath_cache_free(tmp);
 }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stddef.h>
+
 /**
    Implement this function to expand all symlinks in @path and
    convert it to an absolute path that points to the same file
@@ -20,6 +22,39 @@
  */
 void abspath(const char *path);
 
+struct abspath_cache;
+
+/**
+   Allocate a cache of lstat() and readlink() results to be shared
+   by calls to abspath_many(). Entries are keyed by the resolved path
+   of a parent directory and the name of a child. The cache is never
+   invalidated, so it must not outlive the state of the file system
+   it was filled from.
+
+   Return values:
+   * 0 if successful,
+   * a (negative) errno code if an error occurred.
+ */
+int abspath_cache_init(struct abspath_cache **c);
+
+/**
+   Free resources associated with a cache @c.
+
+   Note: abspath_cache_free(NULL) is a no-op.
+ */
+void abspath_cache_free(struct abspath_cache *c);
+
+/**
+   Resolve @n paths in @paths as if abspath() were called for each
+   of them in order. report_path() and report_error() are called
+   exactly as abspath() would call them.
+
+   Lookups are served from @c and results of new lookups are added
+   to @c. If @c is NULL, a temporary cache is used that lives for
+   the duration of the call.
+ */
+void abspath_many(const char *const *paths, size_t n, struct abspath_cache *c);
+
 /**
    abspath() must call this function once it resolves the path
    to an absolute one with all symlinks removed.
@@ -1,22 +1,44 @@
 #include <solution.h>
 
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <inttypes.h>
 #include <err.h>
 
+static void print_stats(const struct ext2_scan_stats *s)
+{
+	printf("inodes: %" PRIu64 " (%" PRIu64 " corrupted)\n", s->nr_inodes, s->nr_bad_inodes);
+	printf("blocks: %" PRIu64 " in %" PRIu64 " extents, fragmentation %.4f\n",
+	       s->nr_blocks, s->nr_extents, s->fragmentation);
+	printf("blocks referenced twice: %" PRIu64 "\n", s->nr_dup_blocks);
+	printf("blocks referenced but free: %" PRIu64 "\n", s->nr_free_referenced);
+	printf("blocks used but unreferenced: %" PRIu64 "\n", s->nr_used_unreferenced);
+
+	printf("file sizes:\n");
+	for (int k = 0; k < EXT2_SCAN_SIZE_BUCKETS; ++k) {
+		if (s->size_hist[k] == 0)
+			continue;
+		if (k == 0)
+			printf("  0: %" PRIu64 "\n", s->size_hist[k]);
+		else
+			printf("  < 2^%i: %" PRIu64 "\n", k, s->size_hist[k]);
+	}
+}
+
 int main(int argc, char **argv)
 {
 	if (argc != 3) {
 		fprintf(stderr, "use: ./a.out <img-file-name> <inode-nr>\n");
+		fprintf(stderr, "     ./a.out <img-file-name> scan\n");
 		return 1;
 	}
 
 	int img = open(argv[1], O_RDONLY);
 	if (img < 0)
 		errx(1, "open(img) failed");
-	int ino = atoi(argv[2]);
 
 	struct ext2_fs *fs = NULL;
 	struct ext2_blkiter *i = NULL;
@@ -24,6 +46,17 @@ int main(int argc, char **argv)
 
 	if ((r = ext2_fs_init(&fs, img)))
 		errx(1, "ext2_fs_init() failed");
+
+	if (strcmp(argv[2], "scan") == 0) {
+		struct ext2_scan_stats stats;
+		if ((r = ext2_scan(fs, 0, &stats)))
+			errx(1, "ext2_scan() failed");
+		print_stats(&stats);
+		ext2_fs_free(fs);
+		return 0;
+	}
+
+	int ino = atoi(argv[2]);
 	if ((r = ext2_blkiter_init(&i, fs, ino)))
 		errx(1, "ext2_blkiter_init() failed");
 
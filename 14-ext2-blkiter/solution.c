@@ -1,51 +1,561 @@
 #include <solution.h>
+#include <ext2.h>
 #include <fs_malloc.h>
 
+#include <sys/stat.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
 #include <errno.h>
 
 struct ext2_fs
 {
-	/* implement me */
+	int fd;
+	struct ext2_super_block sb;
+	uint32_t block_size;
+	uint32_t inode_size;
+	uint32_t nr_groups;
+	uint32_t gdt_blocks;
+	struct ext2_group_desc *gdt;
 };
 
+/*
+   The iterator visits i_block[] in order, and descends into indirect
+   blocks depth-first, reporting every indirect block before the blocks
+   it points to. @stack holds the indirect blocks on the current path.
+ */
 struct ext2_blkiter
 {
-	/* implement me */
+	const struct ext2_fs *fs;
+	struct ext2_inode inode;
+
+	int pos;
+	int depth;
+	struct
+	{
+		uint32_t *buf;
+		uint32_t idx;
+		int level;
+	} stack[3];
 };
 
+static int read_exact(int fd, void *buf, size_t len, off_t off)
+{
+	while (len > 0) {
+		ssize_t n = pread(fd, buf, len, off);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		if (n == 0)
+			return -EIO;
+		buf = (char *)buf + n;
+		len -= n;
+		off += n;
+	}
+	return 0;
+}
+
 int ext2_fs_init(struct ext2_fs **fs, int fd)
 {
-	/* implement me */
-	(void) fs;
-	(void) fd;
-	return -EOPNOTSUPP;
+	struct ext2_fs *x = fs_xzalloc(sizeof(*x));
+	struct ext2_super_block *sb = &x->sb;
+	int r;
+
+	x->fd = fd;
+	if ((r = read_exact(fd, sb, sizeof(*sb), EXT2_SUPERBLOCK_OFFSET)) < 0)
+		goto fail;
+
+	r = -EPROTO;
+	if (sb->s_magic != EXT2_SUPER_MAGIC || sb->s_log_block_size > 6 ||
+	    sb->s_blocks_per_group == 0 || sb->s_inodes_per_group == 0 ||
+	    sb->s_first_data_block >= sb->s_blocks_count)
+		goto fail;
+
+	x->block_size = 1024u << sb->s_log_block_size;
+	x->inode_size = sb->s_rev_level == EXT2_GOOD_OLD_REV ?
+		EXT2_GOOD_OLD_INODE_SIZE : sb->s_inode_size;
+	if (x->inode_size < EXT2_GOOD_OLD_INODE_SIZE || x->inode_size > x->block_size ||
+	    sb->s_inodes_per_group > x->block_size * 8 ||
+	    sb->s_blocks_per_group > x->block_size * 8)
+		goto fail;
+
+	x->nr_groups = (sb->s_blocks_count - sb->s_first_data_block +
+			sb->s_blocks_per_group - 1) / sb->s_blocks_per_group;
+	if ((uint64_t)x->nr_groups * sb->s_inodes_per_group < sb->s_inodes_count)
+		goto fail;
+
+	size_t gdt_size = (size_t)x->nr_groups * sizeof(x->gdt[0]);
+	x->gdt_blocks = (gdt_size + x->block_size - 1) / x->block_size;
+	x->gdt = fs_xmalloc(gdt_size);
+	r = read_exact(fd, x->gdt, gdt_size,
+		       (off_t)(sb->s_first_data_block + 1) * x->block_size);
+	if (r < 0)
+		goto fail;
+
+	*fs = x;
+	return 0;
+
+fail:
+	/* The caller keeps @fd if initialisation fails. */
+	x->fd = -1;
+	ext2_fs_free(x);
+	return r;
 }
 
 void ext2_fs_free(struct ext2_fs *fs)
 {
-	/* implement me */
-	(void) fs;
+	if (fs == NULL)
+		return;
+
+	if (fs->fd >= 0)
+		close(fs->fd);
+	fs_xfree(fs->gdt);
+	fs_xfree(fs);
+}
+
+static bool has_blocks(const struct ext2_fs *fs, const struct ext2_inode *inode)
+{
+	if (S_ISREG(inode->i_mode) || S_ISDIR(inode->i_mode))
+		return true;
+	if (!S_ISLNK(inode->i_mode))
+		return false;
+
+	/* A fast symlink keeps its target in i_block[]. */
+	uint32_t ea_sectors = inode->i_file_acl ? fs->block_size / 512 : 0;
+	return inode->i_blocks != ea_sectors;
+}
+
+static void blkiter_alloc(struct ext2_blkiter *i, const struct ext2_fs *fs)
+{
+	i->fs = fs;
+	for (int k = 0; k < 3; ++k)
+		i->stack[k].buf = fs_xmalloc(fs->block_size);
+}
+
+static void blkiter_reset(struct ext2_blkiter *i, const struct ext2_inode *inode)
+{
+	i->inode = *inode;
+	i->depth = 0;
+	i->pos = has_blocks(i->fs, inode) ? 0 : EXT2_N_BLOCKS;
+}
+
+static void blkiter_release(struct ext2_blkiter *i)
+{
+	for (int k = 0; k < 3; ++k)
+		fs_xfree(i->stack[k].buf);
+}
+
+static int read_inode(const struct ext2_fs *fs, int ino, struct ext2_inode *inode)
+{
+	uint32_t group = (ino - 1) / fs->sb.s_inodes_per_group;
+	uint32_t index = (ino - 1) % fs->sb.s_inodes_per_group;
+	const struct ext2_group_desc *gd = &fs->gdt[group];
+
+	uint8_t byte;
+	int r = read_exact(fs->fd, &byte, 1,
+			   (off_t)gd->bg_inode_bitmap * fs->block_size + index / 8);
+	if (r < 0)
+		return r;
+	if (!(byte & (1 << (index % 8))))
+		return -ENOENT;
+
+	return read_exact(fs->fd, inode, sizeof(*inode),
+			  (off_t)gd->bg_inode_table * fs->block_size +
+			  (off_t)index * fs->inode_size);
 }
 
 int ext2_blkiter_init(struct ext2_blkiter **i, struct ext2_fs *fs, int ino)
 {
-	/* implement me */
-	(void) i;
-	(void) fs;
-	(void) ino;
-	return -EOPNOTSUPP;
+	if (ino <= 0 || (uint32_t)ino > fs->sb.s_inodes_count)
+		return -EINVAL;
+
+	struct ext2_inode inode;
+	int r = read_inode(fs, ino, &inode);
+	if (r < 0)
+		return r;
+
+	struct ext2_blkiter *x = fs_xzalloc(sizeof(*x));
+	blkiter_alloc(x, fs);
+	blkiter_reset(x, &inode);
+	*i = x;
+	return 0;
+}
+
+static bool block_valid(const struct ext2_fs *fs, uint32_t b)
+{
+	return b >= fs->sb.s_first_data_block && b < fs->sb.s_blocks_count;
 }
 
 int ext2_blkiter_next(struct ext2_blkiter *i, int *blkno)
 {
-	/* implement me */
-	(void) i;
-	(void) blkno;
-	return 0;
+	const struct ext2_fs *fs = i->fs;
+	uint32_t per = fs->block_size / sizeof(uint32_t);
+
+	for (;;) {
+		uint32_t b;
+		int level;
+
+		if (i->depth > 0) {
+			typeof(i->stack[0]) *top = &i->stack[i->depth - 1];
+			if (top->idx == per) {
+				--i->depth;
+				continue;
+			}
+			b = top->buf[top->idx++];
+			level = top->level - 1;
+		} else {
+			if (i->pos == EXT2_N_BLOCKS)
+				return 0;
+			level = i->pos < EXT2_NDIR_BLOCKS ? 0 : i->pos - EXT2_NDIR_BLOCKS + 1;
+			b = i->inode.i_block[i->pos++];
+		}
+
+		/* A hole, possibly spanning a whole indirect subtree. */
+		if (b == 0)
+			continue;
+		if (!block_valid(fs, b))
+			return -EPROTO;
+
+		if (level > 0) {
+			typeof(i->stack[0]) *next = &i->stack[i->depth];
+			int r = read_exact(fs->fd, next->buf, fs->block_size,
+					   (off_t)b * fs->block_size);
+			if (r < 0)
+				return r;
+			next->idx = 0;
+			next->level = level;
+			++i->depth;
+		}
+
+		*blkno = b;
+		return 1;
+	}
 }
 
 void ext2_blkiter_free(struct ext2_blkiter *i)
 {
-	/* implement me */
-	(void) i;
+	if (i == NULL)
+		return;
+
+	blkiter_release(i);
+	fs_xfree(i);
+}
+
+/*
+   The scanner. Workers pick block groups off a shared counter, so that
+   large and empty groups balance out. Each worker has its own stats and
+   scratch buffers. The only shared state is a bitmap of blocks seen so
+   far, updated with atomic ORs, which detects duplicate references.
+ */
+struct scan
+{
+	struct ext2_fs *fs;
+	uint64_t *seen;
+
+	uint32_t next_group;
+	int err;
+};
+
+struct worker
+{
+	pthread_t thread;
+	struct scan *scan;
+	int (*fn)(struct worker *w, uint32_t group);
+
+	struct ext2_scan_stats stats;
+	uint64_t nr_steps;
+
+	struct ext2_blkiter iter;
+	uint8_t *bitmap;
+	uint8_t *table;
+	uint32_t *blocks;
+	size_t blocks_cap;
+};
+
+/* Mark a block as seen, and return whether it was seen before. */
+static bool mark_seen(struct scan *s, uint32_t b)
+{
+	uint64_t bit = 1ULL << (b % 64);
+	return __atomic_fetch_or(&s->seen[b / 64], bit, __ATOMIC_RELAXED) & bit;
+}
+
+static bool test_seen(const struct scan *s, uint32_t b)
+{
+	return s->seen[b / 64] & (1ULL << (b % 64));
+}
+
+static uint32_t group_start(const struct ext2_fs *fs, uint32_t group)
+{
+	return fs->sb.s_first_data_block + group * fs->sb.s_blocks_per_group;
+}
+
+static uint32_t group_len(const struct ext2_fs *fs, uint32_t group)
+{
+	uint32_t start = group_start(fs, group);
+	uint32_t len = fs->sb.s_blocks_per_group;
+	return fs->sb.s_blocks_count - start < len ? fs->sb.s_blocks_count - start : len;
+}
+
+static bool is_power_of(uint32_t x, uint32_t base)
+{
+	while (x % base == 0)
+		x /= base;
+	return x == 1;
+}
+
+static bool group_has_super(const struct ext2_fs *fs, uint32_t group)
+{
+	if (!(fs->sb.s_feature_ro_compat & EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER))
+		return true;
+	return group <= 1 || is_power_of(group, 3) || is_power_of(group, 5) ||
+		is_power_of(group, 7);
+}
+
+/*
+   Mark the superblock and descriptor copies, bitmaps and inode tables
+   as seen. Reserved GDT blocks are not marked, since the resize inode
+   references them.
+ */
+static int mark_metadata(struct scan *s)
+{
+	const struct ext2_fs *fs = s->fs;
+	uint32_t table_blocks = ((uint64_t)fs->sb.s_inodes_per_group * fs->inode_size +
+				 fs->block_size - 1) / fs->block_size;
+
+	for (uint32_t g = 0; g < fs->nr_groups; ++g) {
+		const struct ext2_group_desc *gd = &fs->gdt[g];
+
+		if (group_has_super(fs, g)) {
+			uint32_t start = group_start(fs, g);
+			for (uint32_t k = 0; k < 1 + fs->gdt_blocks; ++k)
+				mark_seen(s, start + k);
+		}
+
+		if (!block_valid(fs, gd->bg_block_bitmap) ||
+		    !block_valid(fs, gd->bg_inode_bitmap) ||
+		    !block_valid(fs, gd->bg_inode_table) ||
+		    gd->bg_inode_table + table_blocks > fs->sb.s_blocks_count)
+			return -EPROTO;
+
+		mark_seen(s, gd->bg_block_bitmap);
+		mark_seen(s, gd->bg_inode_bitmap);
+		for (uint32_t k = 0; k < table_blocks; ++k)
+			mark_seen(s, gd->bg_inode_table + k);
+	}
+	return 0;
+}
+
+static int scan_inode(struct worker *w, const struct ext2_inode *inode)
+{
+	struct scan *s = w->scan;
+	size_t n = 0;
+	int blkno;
+	int r;
+
+	blkiter_reset(&w->iter, inode);
+	while ((r = ext2_blkiter_next(&w->iter, &blkno)) > 0) {
+		if (n == w->blocks_cap) {
+			w->blocks_cap = w->blocks_cap ? w->blocks_cap * 2 : 1024;
+			w->blocks = fs_xrealloc(w->blocks, w->blocks_cap * sizeof(w->blocks[0]));
+		}
+		w->blocks[n++] = blkno;
+	}
+
+	/* Blocks are only accounted once the whole list is known to be
+	   sane, so that a corrupted inode does not skew the cross-check. */
+	if (r == -EPROTO) {
+		w->stats.nr_inodes++;
+		w->stats.nr_bad_inodes++;
+		return 0;
+	}
+	if (r < 0)
+		return r;
+
+	w->stats.nr_inodes++;
+
+	if (S_ISREG(inode->i_mode)) {
+		uint64_t size = inode->i_size;
+		if (s->fs->sb.s_feature_ro_compat & EXT2_FEATURE_RO_COMPAT_LARGE_FILE)
+			size |= (uint64_t)inode->i_size_high << 32;
+		w->stats.size_hist[size ? 64 - __builtin_clzll(size) : 0]++;
+	}
+
+	for (size_t k = 0; k < n; ++k) {
+		if (mark_seen(s, w->blocks[k]))
+			w->stats.nr_dup_blocks++;
+		if (k == 0 || w->blocks[k] != w->blocks[k - 1] + 1)
+			w->stats.nr_extents++;
+	}
+	w->stats.nr_blocks += n;
+	if (n)
+		w->nr_steps += n - 1;
+
+	/* Extended attribute blocks may be shared between inodes. */
+	if (inode->i_file_acl && block_valid(s->fs, inode->i_file_acl))
+		mark_seen(s, inode->i_file_acl);
+	return 0;
+}
+
+static int scan_group(struct worker *w, uint32_t group)
+{
+	const struct ext2_fs *fs = w->scan->fs;
+	const struct ext2_group_desc *gd = &fs->gdt[group];
+	uint32_t ipg = fs->sb.s_inodes_per_group;
+	int r;
+
+	if ((r = read_exact(fs->fd, w->bitmap, fs->block_size,
+			    (off_t)gd->bg_inode_bitmap * fs->block_size)) < 0)
+		return r;
+	if ((r = read_exact(fs->fd, w->table, (size_t)ipg * fs->inode_size,
+			    (off_t)gd->bg_inode_table * fs->block_size)) < 0)
+		return r;
+
+	for (uint32_t k = 0; k < ipg; ++k) {
+		uint64_t ino = (uint64_t)group * ipg + k + 1;
+		if (ino > fs->sb.s_inodes_count)
+			break;
+		if (!(w->bitmap[k / 8] & (1 << (k % 8))))
+			continue;
+
+		struct ext2_inode inode;
+		memcpy(&inode, w->table + (size_t)k * fs->inode_size, sizeof(inode));
+		if ((r = scan_inode(w, &inode)) < 0)
+			return r;
+	}
+	return 0;
+}
+
+static int check_group(struct worker *w, uint32_t group)
+{
+	const struct ext2_fs *fs = w->scan->fs;
+	uint32_t start = group_start(fs, group);
+	uint32_t len = group_len(fs, group);
+
+	int r = read_exact(fs->fd, w->bitmap, fs->block_size,
+			   (off_t)fs->gdt[group].bg_block_bitmap * fs->block_size);
+	if (r < 0)
+		return r;
+
+	for (uint32_t k = 0; k < len; ++k) {
+		bool used = w->bitmap[k / 8] & (1 << (k % 8));
+		bool seen = test_seen(w->scan, start + k);
+
+		if (used && !seen)
+			w->stats.nr_used_unreferenced++;
+		else if (!used && seen)
+			w->stats.nr_free_referenced++;
+	}
+	return 0;
+}
+
+static void* worker_main(void *arg)
+{
+	struct worker *w = arg;
+	struct scan *s = w->scan;
+
+	for (;;) {
+		if (__atomic_load_n(&s->err, __ATOMIC_RELAXED))
+			break;
+
+		uint32_t g = __atomic_fetch_add(&s->next_group, 1, __ATOMIC_RELAXED);
+		if (g >= s->fs->nr_groups)
+			break;
+
+		int r = w->fn(w, g);
+		if (r < 0) {
+			int expected = 0;
+			__atomic_compare_exchange_n(&s->err, &expected, r, false,
+						    __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+			break;
+		}
+	}
+	return NULL;
+}
+
+/* Run @fn for every block group on @nr workers, and wait for them. */
+static int run_workers(struct scan *s, struct worker *workers, int nr,
+		       int (*fn)(struct worker *w, uint32_t group))
+{
+	s->next_group = 0;
+
+	int started = 0;
+	for (; started < nr; ++started) {
+		workers[started].fn = fn;
+		if (pthread_create(&workers[started].thread, NULL, worker_main, &workers[started]))
+			break;
+	}
+	/* At least one worker must run, or nothing gets scanned. */
+	if (started == 0)
+		worker_main(&workers[0]);
+
+	for (int k = 0; k < started; ++k)
+		pthread_join(workers[k].thread, NULL);
+	return s->err;
+}
+
+static void merge_stats(struct ext2_scan_stats *to, const struct ext2_scan_stats *from)
+{
+	to->nr_inodes += from->nr_inodes;
+	to->nr_bad_inodes += from->nr_bad_inodes;
+	for (int k = 0; k < EXT2_SCAN_SIZE_BUCKETS; ++k)
+		to->size_hist[k] += from->size_hist[k];
+	to->nr_blocks += from->nr_blocks;
+	to->nr_extents += from->nr_extents;
+	to->nr_dup_blocks += from->nr_dup_blocks;
+	to->nr_free_referenced += from->nr_free_referenced;
+	to->nr_used_unreferenced += from->nr_used_unreferenced;
+}
+
+int ext2_scan(struct ext2_fs *fs, int nr_threads, struct ext2_scan_stats *stats)
+{
+	if (nr_threads <= 0) {
+		long nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		nr_threads = nr_cpus > 0 ? nr_cpus : 1;
+	}
+	if ((uint32_t)nr_threads > fs->nr_groups)
+		nr_threads = fs->nr_groups;
+
+	struct scan s = {.fs = fs};
+	s.seen = fs_xzalloc(((size_t)fs->sb.s_blocks_count + 63) / 64 * sizeof(s.seen[0]));
+
+	struct worker *workers = fs_xzalloc(nr_threads * sizeof(workers[0]));
+	for (int k = 0; k < nr_threads; ++k) {
+		struct worker *w = &workers[k];
+		w->scan = &s;
+		blkiter_alloc(&w->iter, fs);
+		w->bitmap = fs_xmalloc(fs->block_size);
+		w->table = fs_xmalloc((size_t)fs->sb.s_inodes_per_group * fs->inode_size);
+	}
+
+	int r = mark_metadata(&s);
+	if (r == 0)
+		r = run_workers(&s, workers, nr_threads, scan_group);
+	if (r == 0)
+		r = run_workers(&s, workers, nr_threads, check_group);
+
+	memset(stats, 0, sizeof(*stats));
+	uint64_t nr_steps = 0;
+	for (int k = 0; k < nr_threads; ++k) {
+		struct worker *w = &workers[k];
+		merge_stats(stats, &w->stats);
+		nr_steps += w->nr_steps;
+
+		fs_xfree(w->blocks);
+		fs_xfree(w->table);
+		fs_xfree(w->bitmap);
+		blkiter_release(&w->iter);
+	}
+
+	/* Every inode with blocks starts one extent, and every other
+	   extent is a jump. */
+	uint64_t nr_with_blocks = stats->nr_blocks - nr_steps;
+	uint64_t nr_jumps = stats->nr_extents - nr_with_blocks;
+	stats->fragmentation = nr_steps ? (double)nr_jumps / nr_steps : 0;
+
+	fs_xfree(workers);
+	fs_xfree(s.seen);
+	return r;
 }
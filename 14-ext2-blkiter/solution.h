@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stdint.h>
+
 struct ext2_fs;
 struct ext2_blkiter;
 
@@ -55,3 +57,53 @@ int ext2_blkiter_next(struct ext2_blkiter *i, int *blkno);
    Note: ext2_blkiter_free(NULL) is a no-op.
  */
 void ext2_blkiter_free(struct ext2_blkiter *i);
+
+/* The number of buckets in ext2_scan_stats.size_hist. */
+#define EXT2_SCAN_SIZE_BUCKETS 65
+
+/**
+   Aggregate statistics of all in-use inodes of a file system.
+ */
+struct ext2_scan_stats
+{
+	/* The number of in-use inodes. */
+	uint64_t nr_inodes;
+	/* Inodes whose block lists are corrupted. They are not counted
+	   in any of the fields below. */
+	uint64_t nr_bad_inodes;
+
+	/* size_hist[0] counts empty files, and size_hist[k] counts files
+	   of size in [2^(k-1), 2^k). */
+	uint64_t size_hist[EXT2_SCAN_SIZE_BUCKETS];
+
+	/* Data and indirect blocks referenced by inodes. */
+	uint64_t nr_blocks;
+	/* Runs of physically contiguous blocks, as visited by a blkiter. */
+	uint64_t nr_extents;
+	/* Jumps between blocks of the same inode divided by the number of
+	   block-to-block transitions: 0 if every inode is contiguous, and
+	   1 if no two consecutive blocks are adjacent. */
+	double fragmentation;
+
+	/* Cross-check against the block bitmaps:
+	   * blocks referenced more than once,
+	   * blocks referenced by an inode but marked as free,
+	   * blocks marked as used but referenced by neither an inode
+	     nor the group metadata. */
+	uint64_t nr_dup_blocks;
+	uint64_t nr_free_referenced;
+	uint64_t nr_used_unreferenced;
+};
+
+/**
+   Walk all in-use inodes of @fs, as recorded in the inode bitmaps, and
+   collect @stats. Block groups are scanned in parallel by @nr_threads
+   workers (or one per CPU if @nr_threads is 0), each keeping its own
+   statistics that are merged at the end.
+
+   Return values:
+   * 0 if successful,
+   * a (negative) errno code if an IO error occurred,
+   * -EPROTO if the group metadata is corrupted.
+ */
+int ext2_scan(struct ext2_fs *fs, int nr_threads, struct ext2_scan_stats *stats);
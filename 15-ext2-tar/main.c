@@ -0,0 +1,28 @@
+#include <solution.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <err.h>
+
+int main(int argc, char **argv)
+{
+	if (argc != 2 && argc != 3) {
+		fprintf(stderr, "use: %s <ext2-image> [path] > archive.tar\n", argv[0]);
+		return 1;
+	}
+	if (isatty(STDOUT_FILENO))
+		errx(1, "refusing to write an archive to a terminal");
+
+	int img = open(argv[1], O_RDONLY);
+	if (img < 0)
+		errx(1, "failed to open an ext2 image");
+
+	int r = ext2_tar(img, argc == 3 ? argv[2] : "/", STDOUT_FILENO, 0);
+	if (r)
+		errx(1, "failed to export an image: %s", strerror(-r));
+
+	close(img);
+	return 0;
+}
@@ -0,0 +1,598 @@
+#include <solution.h>
+#include <ustar.h>
+#include <fs_ext2.h>
+#include <fs_malloc.h>
+#include <fs_string.h>
+
+#include <sys/stat.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+/* File data is read in chunks of up to CHUNK_SIZE bytes, and at most
+   NR_SLOTS headers and chunks are buffered ahead of the writer. */
+#define CHUNK_SIZE (1 << 20)
+#define NR_SLOTS 64
+
+enum slot_state
+{
+	SLOT_FREE,
+	/* A chunk of file data waiting for a worker. */
+	SLOT_PENDING,
+	SLOT_READING,
+	/* Headers, or a chunk that has been read. */
+	SLOT_READY,
+};
+
+/*
+   A piece of the archive in the order it is written. The walker fills
+   headers itself, and leaves chunks of file data to workers as a list
+   of block runs to read.
+ */
+struct slot
+{
+	enum slot_state state;
+	struct fs_strbuf buf;
+	/* The number of zero bytes to write after @buf. */
+	size_t pad;
+
+	struct fs_ext2_run *runs;
+	size_t nr_runs;
+	size_t nr_blocks;
+	/* The size of the chunk, the last block may be partial. */
+	size_t len;
+	int err;
+};
+
+struct child
+{
+	struct child *next;
+	uint32_t ino;
+	char name[];
+};
+
+struct export
+{
+	const struct fs_ext2 *fs;
+	int out;
+
+	pthread_mutex_t lock;
+	pthread_cond_t slot_free;
+	pthread_cond_t work;
+	pthread_cond_t ready;
+
+	struct slot slots[NR_SLOTS];
+	/* Slots are numbered in the archive order: [@head, @tail) are
+	   in use, and workers look for chunks to read from @claim on. */
+	uint64_t head;
+	uint64_t tail;
+	uint64_t claim;
+	bool walk_done;
+	int err;
+
+	/* The state of the walker. */
+	struct fs_arena arena;
+	struct fs_strbuf path;
+	struct fs_strbuf link;
+	struct fs_ext2_run *runs;
+	size_t nr_runs;
+	size_t runs_cap;
+	struct tar_segment *segments;
+	size_t segments_cap;
+};
+
+static void set_error(struct export *x, int err)
+{
+	pthread_mutex_lock(&x->lock);
+	if (x->err == 0)
+		x->err = err;
+	pthread_cond_broadcast(&x->slot_free);
+	pthread_cond_broadcast(&x->work);
+	pthread_cond_broadcast(&x->ready);
+	pthread_mutex_unlock(&x->lock);
+}
+
+/* Wait for a free slot at the tail, and return NULL if the export failed. */
+static struct slot* get_slot(struct export *x)
+{
+	struct slot *s = NULL;
+
+	pthread_mutex_lock(&x->lock);
+	while (x->tail - x->head == NR_SLOTS && x->err == 0)
+		pthread_cond_wait(&x->slot_free, &x->lock);
+	if (x->err == 0) {
+		s = &x->slots[x->tail % NR_SLOTS];
+		fs_strbuf_clear(&s->buf);
+		s->pad = 0;
+		s->nr_runs = 0;
+		s->nr_blocks = 0;
+		s->len = 0;
+		s->err = 0;
+	}
+	pthread_mutex_unlock(&x->lock);
+	return s;
+}
+
+static void publish(struct export *x, struct slot *s, enum slot_state state)
+{
+	pthread_mutex_lock(&x->lock);
+	s->state = state;
+	++x->tail;
+	if (state == SLOT_PENDING)
+		pthread_cond_signal(&x->work);
+	else
+		pthread_cond_signal(&x->ready);
+	pthread_mutex_unlock(&x->lock);
+}
+
+static int read_chunk(const struct fs_ext2 *fs, struct slot *s)
+{
+	size_t bs = fs->block_size;
+
+	fs_strbuf_reserve(&s->buf, s->nr_blocks * bs);
+
+	size_t off = 0;
+	for (size_t i = 0; i < s->nr_runs; ++i) {
+		const struct fs_ext2_run *run = &s->runs[i];
+		int r = fs_ext2_pread(fs, s->buf.s + off, (size_t)run->len * bs,
+				      (uint64_t)run->pbn * bs);
+		if (r < 0)
+			return r;
+		off += (size_t)run->len * bs;
+	}
+
+	fs_strbuf_truncate(&s->buf, s->len);
+	return 0;
+}
+
+static void* worker(void *arg)
+{
+	struct export *x = arg;
+
+	pthread_mutex_lock(&x->lock);
+	for (;;) {
+		if (x->claim < x->head)
+			x->claim = x->head;
+		while (x->claim < x->tail && x->slots[x->claim % NR_SLOTS].state != SLOT_PENDING)
+			++x->claim;
+
+		if (x->err)
+			break;
+		if (x->claim == x->tail) {
+			if (x->walk_done)
+				break;
+			pthread_cond_wait(&x->work, &x->lock);
+			continue;
+		}
+
+		struct slot *s = &x->slots[x->claim++ % NR_SLOTS];
+		s->state = SLOT_READING;
+		pthread_mutex_unlock(&x->lock);
+
+		s->err = read_chunk(x->fs, s);
+
+		pthread_mutex_lock(&x->lock);
+		s->state = SLOT_READY;
+		pthread_cond_signal(&x->ready);
+	}
+	pthread_mutex_unlock(&x->lock);
+	return NULL;
+}
+
+static int write_all(int fd, const char *buf, size_t len)
+{
+	while (len > 0) {
+		ssize_t n = write(fd, buf, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/* Write slots in order until the walker is done, or something fails. */
+static void write_archive(struct export *x)
+{
+	static const char zeroes[TAR_BLOCK_SIZE];
+
+	pthread_mutex_lock(&x->lock);
+	for (;;) {
+		while (x->err == 0 &&
+		       (x->head == x->tail ? !x->walk_done :
+			x->slots[x->head % NR_SLOTS].state != SLOT_READY))
+			pthread_cond_wait(&x->ready, &x->lock);
+		if (x->err || x->head == x->tail)
+			break;
+
+		struct slot *s = &x->slots[x->head % NR_SLOTS];
+		pthread_mutex_unlock(&x->lock);
+
+		int r = s->err;
+		if (r == 0)
+			r = write_all(x->out, s->buf.s, s->buf.len);
+		if (r == 0)
+			r = write_all(x->out, zeroes, s->pad);
+		if (r < 0) {
+			set_error(x, r);
+			pthread_mutex_lock(&x->lock);
+			break;
+		}
+
+		pthread_mutex_lock(&x->lock);
+		s->state = SLOT_FREE;
+		++x->head;
+		pthread_cond_signal(&x->slot_free);
+	}
+	pthread_mutex_unlock(&x->lock);
+}
+
+static uint32_t inode_uid(const struct ext2_inode *inode)
+{
+	/* Linux keeps the high 16 bits in l_i_uid_high and l_i_gid_high. */
+	return inode->i_uid | (uint32_t)(inode->i_osd2[4] | inode->i_osd2[5] << 8) << 16;
+}
+
+static uint32_t inode_gid(const struct ext2_inode *inode)
+{
+	return inode->i_gid | (uint32_t)(inode->i_osd2[6] | inode->i_osd2[7] << 8) << 16;
+}
+
+static void device_numbers(const struct ext2_inode *inode, struct tar_entry *e)
+{
+	uint32_t old = inode->i_block[0];
+	uint32_t new = inode->i_block[1];
+
+	if (old) {
+		e->devmajor = (old >> 8) & 0xff;
+		e->devminor = old & 0xff;
+	} else {
+		e->devmajor = (new & 0xfff00) >> 8;
+		e->devminor = (new & 0xff) | ((new >> 12) & 0xfff00);
+	}
+}
+
+static int emit_header(struct export *x, const struct tar_entry *e)
+{
+	struct slot *s = get_slot(x);
+	if (!s)
+		return x->err;
+
+	tar_append_header(&s->buf, e);
+	publish(x, s, SLOT_READY);
+	return 0;
+}
+
+static int collect_run(const struct fs_ext2_run *run, void *arg)
+{
+	struct export *x = arg;
+
+	if (x->nr_runs == x->runs_cap) {
+		x->runs_cap = x->runs_cap ? 2 * x->runs_cap : 64;
+		x->runs = fs_xrealloc(x->runs, x->runs_cap * sizeof(x->runs[0]));
+	}
+	x->runs[x->nr_runs++] = *run;
+	return 0;
+}
+
+/*
+   Emit a regular file: collect the runs of its allocated blocks,
+   describe them as segments if there are holes, and queue them in
+   chunks for workers to read. Both the walk and the buffers grow with
+   the number of runs, not with the size of the file.
+ */
+static int emit_file(struct export *x, struct tar_entry *e, const struct ext2_inode *inode)
+{
+	const struct fs_ext2 *fs = x->fs;
+	size_t bs = fs->block_size;
+	uint64_t nr_blocks = (e->size + bs - 1) / bs;
+	size_t nr_segments = 0;
+	int r;
+
+	x->nr_runs = 0;
+	if ((r = fs_ext2_walk_runs(fs, inode, nr_blocks, collect_run, x)) < 0)
+		return r;
+
+	for (size_t i = 0; i < x->nr_runs; ++i) {
+		uint64_t off = x->runs[i].lbn * bs;
+		uint64_t end = (x->runs[i].lbn + x->runs[i].len) * bs;
+		uint64_t len = (end < e->size ? end : e->size) - off;
+
+		struct tar_segment *last = nr_segments ? &x->segments[nr_segments - 1] : NULL;
+		if (last && last->off + last->len == off) {
+			last->len += len;
+			continue;
+		}
+		if (nr_segments == x->segments_cap) {
+			x->segments_cap *= 2;
+			x->segments = fs_xrealloc(x->segments, x->segments_cap * sizeof(x->segments[0]));
+		}
+		x->segments[nr_segments++] = (struct tar_segment){off, len};
+	}
+
+	if (e->size > 0 && !(nr_segments == 1 && x->segments[0].len == e->size)) {
+		e->segments = x->segments;
+		e->nr_segments = nr_segments;
+	}
+	if ((r = emit_header(x, e)) < 0)
+		return r;
+
+	uint64_t data_size = tar_data_size(e);
+	size_t chunk_blocks = CHUNK_SIZE / bs;
+	struct slot *s = NULL;
+
+	for (size_t i = 0; i < x->nr_runs; ++i) {
+		struct fs_ext2_run run = x->runs[i];
+
+		while (run.len > 0) {
+			if (!s) {
+				if (!(s = get_slot(x)))
+					return x->err;
+				if (!s->runs)
+					s->runs = fs_xmalloc(chunk_blocks * sizeof(s->runs[0]));
+			}
+
+			uint32_t n = run.len;
+			if (n > chunk_blocks - s->nr_blocks)
+				n = chunk_blocks - s->nr_blocks;
+			uint64_t end = (run.lbn + n) * bs;
+
+			s->runs[s->nr_runs++] = (struct fs_ext2_run){run.lbn, run.pbn, n};
+			s->nr_blocks += n;
+			s->len += (end < e->size ? end : e->size) - run.lbn * bs;
+			run.lbn += n;
+			run.pbn += n;
+			run.len -= n;
+
+			if (s->nr_blocks == chunk_blocks) {
+				publish(x, s, SLOT_PENDING);
+				s = NULL;
+			}
+		}
+	}
+	if (s)
+		publish(x, s, SLOT_PENDING);
+
+	/* Pad the data with a slot of its own, the last chunk may be
+	   already written by now. */
+	if (tar_padding(data_size)) {
+		if (!(s = get_slot(x)))
+			return x->err;
+		s->pad = tar_padding(data_size);
+		publish(x, s, SLOT_READY);
+	}
+	return 0;
+}
+
+static int walk_dir(struct export *x, const struct ext2_inode *dir);
+
+/* Emit an inode @ino named by x->path, and everything below it. */
+static int emit_inode(struct export *x, uint32_t ino)
+{
+	const struct fs_ext2 *fs = x->fs;
+	struct ext2_inode inode;
+	int r;
+
+	if ((r = fs_ext2_read_inode(fs, ino, &inode)) < 0)
+		return r;
+
+	struct tar_entry e = {
+		.path = x->path.s,
+		.mode = inode.i_mode,
+		.uid = inode_uid(&inode),
+		.gid = inode_gid(&inode),
+		.mtime = inode.i_mtime,
+	};
+
+	switch (inode.i_mode & S_IFMT) {
+	case S_IFREG:
+		e.type = TAR_REG;
+		e.size = fs_ext2_inode_size(fs, &inode);
+		return emit_file(x, &e, &inode);
+
+	case S_IFDIR: {
+		size_t len = x->path.len;
+
+		fs_strbuf_appendc(&x->path, '/');
+		e.path = x->path.s;
+		e.type = TAR_DIR;
+		if ((r = emit_header(x, &e)) < 0)
+			return r;
+		r = walk_dir(x, &inode);
+		fs_strbuf_truncate(&x->path, len);
+		return r;
+	}
+
+	case S_IFLNK:
+		if ((r = fs_ext2_readlink(fs, &inode, &x->link)) < 0)
+			return r;
+		e.type = TAR_SYMLINK;
+		e.linkname = x->link.s;
+		return emit_header(x, &e);
+
+	case S_IFCHR:
+	case S_IFBLK:
+		e.type = S_ISCHR(inode.i_mode) ? TAR_CHR : TAR_BLK;
+		device_numbers(&inode, &e);
+		return emit_header(x, &e);
+
+	case S_IFIFO:
+		e.type = TAR_FIFO;
+		return emit_header(x, &e);
+
+	default:
+		/* Sockets cannot be archived. */
+		return 0;
+	}
+}
+
+struct collect
+{
+	struct fs_arena *arena;
+	struct child **tail;
+};
+
+static int collect_children(const struct fs_ext2_dirent *entries, size_t n, void *arg)
+{
+	struct collect *c = arg;
+
+	for (size_t i = 0; i < n; ++i) {
+		const char *name = entries[i].name;
+		if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+			continue;
+
+		size_t len = strlen(name);
+		struct child *ch = fs_arena_alloc(c->arena, sizeof(*ch) + len + 1);
+		ch->next = NULL;
+		ch->ino = entries[i].inode_nr;
+		memcpy(ch->name, name, len + 1);
+		*c->tail = ch;
+		c->tail = &ch->next;
+	}
+	return 0;
+}
+
+/* Emit the children of @dir in the on-disk order, depth first. Names
+   of a directory stay in the arena until the directory is done. */
+static int walk_dir(struct export *x, const struct ext2_inode *dir)
+{
+	struct fs_arena_mark mark = fs_arena_mark(&x->arena);
+	struct child *children = NULL;
+	struct collect c = {&x->arena, &children};
+	int r;
+
+	if ((r = fs_ext2_read_dir(x->fs, dir, collect_children, &c)) < 0)
+		goto out;
+
+	for (struct child *ch = children; ch; ch = ch->next) {
+		size_t len = fs_strbuf_push_path(&x->path, ch->name);
+		r = emit_inode(x, ch->ino);
+		fs_strbuf_truncate(&x->path, len);
+		if (r < 0)
+			break;
+	}
+
+out:
+	fs_arena_reset(&x->arena, mark);
+	return r;
+}
+
+struct walk_args
+{
+	struct export *x;
+	const char *path;
+};
+
+static void* walker(void *arg)
+{
+	struct walk_args *w = arg;
+	struct export *x = w->x;
+	struct ext2_inode inode;
+	uint32_t ino;
+	int r;
+
+	if ((r = fs_ext2_lookup(x->fs, w->path, &ino, &inode)) < 0)
+		goto out;
+
+	if (S_ISDIR(inode.i_mode)) {
+		r = walk_dir(x, &inode);
+	} else {
+		const char *base = strrchr(w->path, '/');
+		fs_strbuf_appends(&x->path, base ? base + 1 : w->path);
+		r = emit_inode(x, ino);
+	}
+	if (r < 0)
+		goto out;
+
+	struct slot *s = get_slot(x);
+	if (!s)
+		goto out;
+	tar_append_end(&s->buf);
+	publish(x, s, SLOT_READY);
+
+out:
+	if (r < 0)
+		set_error(x, r);
+
+	pthread_mutex_lock(&x->lock);
+	x->walk_done = true;
+	pthread_cond_broadcast(&x->work);
+	pthread_cond_broadcast(&x->ready);
+	pthread_mutex_unlock(&x->lock);
+	return NULL;
+}
+
+int ext2_tar(int img, const char *path, int out, int nr_threads)
+{
+	struct fs_ext2 fs;
+	int r;
+
+	if ((r = fs_ext2_load(&fs, img)) < 0)
+		return r;
+
+	if (nr_threads <= 0) {
+		long n = sysconf(_SC_NPROCESSORS_ONLN);
+		nr_threads = n > 0 ? n : 1;
+	}
+
+	struct export *x = fs_xzalloc(sizeof(*x));
+	x->fs = &fs;
+	x->out = out;
+	pthread_mutex_init(&x->lock, NULL);
+	pthread_cond_init(&x->slot_free, NULL);
+	pthread_cond_init(&x->work, NULL);
+	pthread_cond_init(&x->ready, NULL);
+	fs_arena_init(&x->arena, 0);
+	/* Allocated up front, a file of holes only is described by an
+	   empty but non-NULL list of segments. */
+	x->segments_cap = 64;
+	x->segments = fs_xmalloc(x->segments_cap * sizeof(x->segments[0]));
+
+	pthread_t *workers = fs_xmalloc(nr_threads * sizeof(workers[0]));
+	int nr_workers = 0;
+	pthread_t walk_thread;
+	struct walk_args w = {x, path};
+
+	for (; nr_workers < nr_threads; ++nr_workers) {
+		if ((r = pthread_create(&workers[nr_workers], NULL, worker, x)) != 0)
+			break;
+	}
+	if (r == 0 && (r = pthread_create(&walk_thread, NULL, walker, &w)) == 0) {
+		write_archive(x);
+		pthread_join(walk_thread, NULL);
+	}
+	if (r != 0)
+		set_error(x, -r);
+
+	/* Wake up workers that still wait for chunks after a failure. */
+	pthread_mutex_lock(&x->lock);
+	x->walk_done = true;
+	pthread_cond_broadcast(&x->work);
+	pthread_mutex_unlock(&x->lock);
+	for (int i = 0; i < nr_workers; ++i)
+		pthread_join(workers[i], NULL);
+	r = x->err;
+
+	for (int i = 0; i < NR_SLOTS; ++i) {
+		fs_xfree(x->slots[i].runs);
+		fs_strbuf_free(&x->slots[i].buf);
+	}
+	fs_xfree(x->segments);
+	fs_xfree(x->runs);
+	fs_strbuf_free(&x->link);
+	fs_strbuf_free(&x->path);
+	fs_arena_release(&x->arena);
+	pthread_cond_destroy(&x->ready);
+	pthread_cond_destroy(&x->work);
+	pthread_cond_destroy(&x->slot_free);
+	pthread_mutex_destroy(&x->lock);
+	fs_xfree(workers);
+	fs_xfree(x);
+	fs_ext2_free(&fs);
+	return r;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+/**
+   Write a tar archive of a file or a directory tree at @path of an
+   ext2 image @img to a file descriptor @out. Members of a directory
+   are named relative to it, and a single file is named by its last
+   path component.
+
+   Directories are walked by one thread, which decides the order of
+   the archive, while @nr_threads workers (or one per CPU if it is 0)
+   read file data ahead of the writer into a bounded set of buffers.
+   Holes of sparse files are not stored.
+
+   If the archive was written successfully, return 0. If an error
+   occurred during a read or a write, return -errno.
+*/
+int ext2_tar(int img, const char *path, int out, int nr_threads);
@@ -0,0 +1,269 @@
+#include <ustar.h>
+
+#include <stdbool.h>
+#include <string.h>
+
+#define NAME_LEN 100
+#define PREFIX_LEN 155
+
+struct ustar_header
+{
+	char name[NAME_LEN];
+	char mode[8];
+	char uid[8];
+	char gid[8];
+	char size[12];
+	char mtime[12];
+	char chksum[8];
+	char typeflag;
+	char linkname[NAME_LEN];
+	char magic[6];
+	char version[2];
+	char uname[32];
+	char gname[32];
+	char devmajor[8];
+	char devminor[8];
+	char prefix[PREFIX_LEN];
+	char pad[12];
+};
+
+_Static_assert(sizeof(struct ustar_header) == TAR_BLOCK_SIZE, "bad ustar header layout");
+
+/* Write @x as a NUL-terminated octal number that fills @width bytes. */
+static bool put_octal(char *field, size_t width, uint64_t x)
+{
+	field[width - 1] = '\0';
+	for (size_t i = width - 1; i > 0; --i) {
+		field[i - 1] = '0' + (x & 7);
+		x >>= 3;
+	}
+	return x == 0;
+}
+
+/* Store @path in the name and prefix fields, and return false if it is too long. */
+static bool put_name(struct ustar_header *h, const char *path)
+{
+	size_t len = strlen(path);
+
+	if (len <= NAME_LEN) {
+		memcpy(h->name, path, len);
+		return true;
+	}
+
+	/* Split at a '/' so that the prefix fits, and the rest is as long as
+	   possible. A trailing '/' of a directory stays in the name. */
+	for (size_t i = len - NAME_LEN - 1; i < len - 1 && i <= PREFIX_LEN; ++i) {
+		if (path[i] == '/' && i > 0) {
+			memcpy(h->prefix, path, i);
+			memcpy(h->name, path + i + 1, len - i - 1);
+			return true;
+		}
+	}
+
+	memcpy(h->name, path, NAME_LEN);
+	return false;
+}
+
+static void append_ustar(struct fs_strbuf *b, struct ustar_header *h)
+{
+	unsigned sum = 0;
+
+	memcpy(h->magic, "ustar", 6);
+	memcpy(h->version, "00", 2);
+	memset(h->chksum, ' ', sizeof(h->chksum));
+	for (size_t i = 0; i < sizeof(*h); ++i)
+		sum += ((const unsigned char *)h)[i];
+	put_octal(h->chksum, 7, sum);
+
+	fs_strbuf_append(b, (const char *)h, sizeof(*h));
+}
+
+static void append_zeroes(struct fs_strbuf *b, size_t n)
+{
+	fs_strbuf_reserve(b, b->len + n);
+	memset(b->s + b->len, 0, n);
+	b->len += n;
+	b->s[b->len] = '\0';
+}
+
+static size_t nr_digits(size_t x)
+{
+	size_t n = 1;
+	for (; x >= 10; x /= 10)
+		++n;
+	return n;
+}
+
+/* Append a "<len> <key>=<value>\n" record, where <len> counts itself. */
+static void pax_record(struct fs_strbuf *pax, const char *key, const char *value)
+{
+	size_t len = strlen(key) + strlen(value) + 3;
+	size_t total = len + nr_digits(len);
+
+	/* The length itself may have added a digit. */
+	if (nr_digits(total) > nr_digits(len))
+		++total;
+
+	fs_strbuf_append_uint(pax, total);
+	fs_strbuf_appendc(pax, ' ');
+	fs_strbuf_appends(pax, key);
+	fs_strbuf_appendc(pax, '=');
+	fs_strbuf_appends(pax, value);
+	fs_strbuf_appendc(pax, '\n');
+}
+
+static void pax_record_uint(struct fs_strbuf *pax, const char *key, uint64_t x)
+{
+	char value[24];
+	char *p = value + sizeof(value);
+
+	*--p = '\0';
+	do {
+		*--p = '0' + x % 10;
+		x /= 10;
+	} while (x);
+	pax_record(pax, key, p);
+}
+
+static const char* base_name(const char *path, size_t *len)
+{
+	size_t end = strlen(path);
+	while (end > 1 && path[end - 1] == '/')
+		--end;
+	size_t start = end;
+	while (start > 0 && path[start - 1] != '/')
+		--start;
+	*len = end - start;
+	return path + start;
+}
+
+uint64_t tar_data_size(const struct tar_entry *e)
+{
+	if (!e->segments)
+		return e->size;
+
+	uint64_t size = 0;
+	for (size_t i = 0; i < e->nr_segments; ++i)
+		size += e->segments[i].len;
+	return size;
+}
+
+/* Append the map of a sparse file, padded to a whole block. */
+static void append_sparse_map(struct fs_strbuf *b, const struct tar_entry *e)
+{
+	size_t start = b->len;
+	const struct tar_segment *last = e->nr_segments ? &e->segments[e->nr_segments - 1] : NULL;
+	/* A file that ends with a hole gets an empty segment at its end. */
+	bool tail = !last || last->off + last->len < e->size;
+
+	fs_strbuf_append_uint(b, e->nr_segments + tail);
+	fs_strbuf_appendc(b, '\n');
+	for (size_t i = 0; i < e->nr_segments; ++i) {
+		fs_strbuf_append_uint(b, e->segments[i].off);
+		fs_strbuf_appendc(b, '\n');
+		fs_strbuf_append_uint(b, e->segments[i].len);
+		fs_strbuf_appendc(b, '\n');
+	}
+	if (tail) {
+		fs_strbuf_append_uint(b, e->size);
+		fs_strbuf_appends(b, "\n0\n");
+	}
+	append_zeroes(b, tar_padding(b->len - start));
+}
+
+void tar_append_header(struct fs_strbuf *b, const struct tar_entry *e)
+{
+	struct fs_strbuf pax = FS_STRBUF_INIT;
+	struct fs_strbuf map = FS_STRBUF_INIT;
+	struct fs_strbuf name = FS_STRBUF_INIT;
+	struct ustar_header h;
+	size_t base_len;
+	const char *base = base_name(e->path, &base_len);
+	uint64_t size = e->type == TAR_REG ? tar_data_size(e) : 0;
+
+	memset(&h, 0, sizeof(h));
+
+	if (e->segments) {
+		/* The real name is in the pax header, while the ustar name
+		   keeps tools without sparse support from overwriting the
+		   file with its packed form. */
+		pax_record(&pax, "GNU.sparse.major", "1");
+		pax_record(&pax, "GNU.sparse.minor", "0");
+		pax_record(&pax, "GNU.sparse.name", e->path);
+		pax_record_uint(&pax, "GNU.sparse.realsize", e->size);
+
+		fs_strbuf_append(&name, e->path, base - e->path);
+		fs_strbuf_appends(&name, "GNUSparseFile.0/");
+		fs_strbuf_append(&name, base, base_len);
+		put_name(&h, name.s);
+
+		append_sparse_map(&map, e);
+		size += map.len;
+	} else if (!put_name(&h, e->path)) {
+		pax_record(&pax, "path", e->path);
+	}
+
+	if (e->linkname) {
+		size_t len = strlen(e->linkname);
+		if (len > NAME_LEN) {
+			pax_record(&pax, "linkpath", e->linkname);
+			len = NAME_LEN;
+		}
+		memcpy(h.linkname, e->linkname, len);
+	}
+
+	if (!put_octal(h.size, sizeof(h.size), size)) {
+		pax_record_uint(&pax, "size", size);
+		put_octal(h.size, sizeof(h.size), 0);
+	}
+	if (!put_octal(h.uid, sizeof(h.uid), e->uid)) {
+		pax_record_uint(&pax, "uid", e->uid);
+		put_octal(h.uid, sizeof(h.uid), 0);
+	}
+	if (!put_octal(h.gid, sizeof(h.gid), e->gid)) {
+		pax_record_uint(&pax, "gid", e->gid);
+		put_octal(h.gid, sizeof(h.gid), 0);
+	}
+	put_octal(h.mode, sizeof(h.mode), e->mode & 07777);
+	put_octal(h.mtime, sizeof(h.mtime), e->mtime);
+	h.typeflag = e->type;
+	if (e->type == TAR_CHR || e->type == TAR_BLK) {
+		put_octal(h.devmajor, sizeof(h.devmajor), e->devmajor);
+		put_octal(h.devminor, sizeof(h.devminor), e->devminor);
+	}
+
+	if (pax.len) {
+		struct ustar_header x;
+
+		memset(&x, 0, sizeof(x));
+		fs_strbuf_clear(&name);
+		fs_strbuf_appends(&name, "PaxHeaders/");
+		fs_strbuf_append(&name, base, base_len);
+		if (name.len > NAME_LEN)
+			fs_strbuf_truncate(&name, NAME_LEN);
+		put_name(&x, name.s);
+		put_octal(x.mode, sizeof(x.mode), 0644);
+		put_octal(x.uid, sizeof(x.uid), 0);
+		put_octal(x.gid, sizeof(x.gid), 0);
+		put_octal(x.size, sizeof(x.size), pax.len);
+		put_octal(x.mtime, sizeof(x.mtime), e->mtime);
+		x.typeflag = 'x';
+
+		append_ustar(b, &x);
+		fs_strbuf_append(b, pax.s, pax.len);
+		append_zeroes(b, tar_padding(pax.len));
+	}
+
+	append_ustar(b, &h);
+	if (map.len)
+		fs_strbuf_append(b, map.s, map.len);
+
+	fs_strbuf_free(&name);
+	fs_strbuf_free(&map);
+	fs_strbuf_free(&pax);
+}
+
+void tar_append_end(struct fs_strbuf *b)
+{
+	append_zeroes(b, 2 * TAR_BLOCK_SIZE);
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <fs_string.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Writing of POSIX (pax) tar archives, as described in pax(1). */
+
+#define TAR_BLOCK_SIZE 512
+
+#define TAR_REG '0'
+#define TAR_SYMLINK '2'
+#define TAR_CHR '3'
+#define TAR_BLK '4'
+#define TAR_DIR '5'
+#define TAR_FIFO '6'
+
+/* A range of a sparse file that holds data. */
+struct tar_segment
+{
+	uint64_t off;
+	uint64_t len;
+};
+
+struct tar_entry
+{
+	/* The member name, directories end with a '/'. */
+	const char *path;
+	char type;
+	uint32_t mode;
+	uint32_t uid;
+	uint32_t gid;
+	uint32_t mtime;
+	uint64_t size;
+	const char *linkname;
+	uint32_t devmajor;
+	uint32_t devminor;
+
+	/* Data of a sparse file, NULL if the whole file is stored. */
+	const struct tar_segment *segments;
+	size_t nr_segments;
+};
+
+/*
+   Append the headers of @e to @b. Names, link targets and sizes that
+   do not fit into a ustar header go to a pax extended header. A sparse
+   file is stored in the GNU 1.0 sparse format, which GNU tar and bsdtar
+   restore with holes.
+
+   tar_data_size(@e) bytes of data must follow the headers: the whole
+   file, or its segments one after another, and then tar_padding() zeroes.
+ */
+void tar_append_header(struct fs_strbuf *b, const struct tar_entry *e);
+
+uint64_t tar_data_size(const struct tar_entry *e);
+
+static inline size_t tar_padding(uint64_t size)
+{
+	return (TAR_BLOCK_SIZE - size % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE;
+}
+
+/* Append the two zero blocks that end an archive. */
+void tar_append_end(struct fs_strbuf *b);
@@ -0,0 +1,95 @@
+#include <solution.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <err.h>
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"use: %s [-t threads] [-d seconds] [-f file] [-o op,...] <mount-point>\n"
+		"  -t  the number of threads (default 4)\n"
+		"  -d  the duration of each operation in seconds (default 5)\n"
+		"  -f  a file under the mount point to stat and read (default hello)\n"
+		"  -o  operations to run: getattr, lookup, readdir, read (default all)\n",
+		prog);
+	exit(1);
+}
+
+static unsigned parse_ops(const char *prog, char *list)
+{
+	unsigned ops = 0;
+
+	for (char *name = strtok(list, ","); name; name = strtok(NULL, ",")) {
+		int op = 0;
+		while (op < NR_BENCH_OPS && strcmp(name, bench_op_name(op)) != 0)
+			++op;
+		if (op == NR_BENCH_OPS)
+			usage(prog);
+		ops |= 1u << op;
+	}
+	return ops;
+}
+
+static double us(uint64_t ns)
+{
+	return ns / 1000.0;
+}
+
+int main(int argc, char **argv)
+{
+	struct bench_config cfg = {
+		.file = "hello",
+		.nr_threads = 4,
+		.duration_ms = 5000,
+		.ops = (1u << NR_BENCH_OPS) - 1,
+	};
+	struct bench_result res[NR_BENCH_OPS];
+	int c;
+
+	while ((c = getopt(argc, argv, "t:d:f:o:")) != -1) {
+		switch (c) {
+		case 't':
+			cfg.nr_threads = atoi(optarg);
+			break;
+		case 'd':
+			cfg.duration_ms = atof(optarg) * 1000;
+			break;
+		case 'f':
+			cfg.file = optarg;
+			break;
+		case 'o':
+			cfg.ops = parse_ops(argv[0], optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind + 1 != argc || cfg.nr_threads <= 0)
+		usage(argv[0]);
+	cfg.mntp = argv[optind];
+
+	int r = fuse_bench(&cfg, res);
+	if (r)
+		errx(1, "benchmark failed: %s", strerror(-r));
+
+	printf("%-8s %8s %12s %12s %10s %10s %10s %10s %10s %8s\n",
+	       "op", "threads", "ops", "ops/s", "avg_us", "p50_us", "p99_us", "p99.9_us",
+	       "max_us", "errors");
+	for (int op = 0; op < NR_BENCH_OPS; ++op) {
+		const struct bench_result *x = &res[op];
+		if (!(cfg.ops & (1u << op)))
+			continue;
+
+		printf("%-8s %8d %12" PRIu64 " %12.0f %10.2f %10.2f %10.2f %10.2f %10.2f %8" PRIu64 "\n",
+		       bench_op_name(op), cfg.nr_threads, x->nr_ops,
+		       x->nr_ops / (x->elapsed_ns / 1e9),
+		       x->nr_ops ? us(x->total_ns / x->nr_ops) : 0.0,
+		       us(x->p50_ns), us(x->p99_ns), us(x->p999_ns), us(x->max_ns),
+		       x->nr_errors);
+	}
+	return 0;
+}
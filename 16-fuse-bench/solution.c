@@ -0,0 +1,271 @@
+#include <solution.h>
+#include <fs_malloc.h>
+#include <fs_string.h>
+
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+
+/*
+   Latencies are kept in log-linear buckets: values below 16 ns exactly,
+   and every larger power of two split into 16 buckets.
+ */
+#define SUB_BITS 4
+#define NR_SUB (1 << SUB_BITS)
+#define NR_BUCKETS ((64 - SUB_BITS + 1) * NR_SUB)
+
+#define READ_SIZE 4096
+
+static const char *const op_names[NR_BENCH_OPS] = {
+	[BENCH_GETATTR] = "getattr",
+	[BENCH_LOOKUP] = "lookup",
+	[BENCH_READDIR] = "readdir",
+	[BENCH_READ] = "read",
+};
+
+const char* bench_op_name(enum bench_op op)
+{
+	return op_names[op];
+}
+
+/* Holds threads of a run until all of them are ready. */
+struct gate
+{
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	bool open;
+	bool cancelled;
+};
+
+struct thread
+{
+	pthread_t tid;
+	const struct bench_config *cfg;
+	enum bench_op op;
+	const char *path;
+	struct gate *gate;
+
+	uint64_t nr_ops;
+	uint64_t nr_errors;
+	uint64_t total_ns;
+	uint64_t max_ns;
+	uint64_t hist[NR_BUCKETS];
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int bucket_of(uint64_t ns)
+{
+	if (ns < NR_SUB)
+		return ns;
+
+	int k = 63 - __builtin_clzll(ns);
+	return (k - SUB_BITS + 1) * NR_SUB + ((ns >> (k - SUB_BITS)) & (NR_SUB - 1));
+}
+
+/* Return the largest value that falls into bucket @b. */
+static uint64_t bucket_max(int b)
+{
+	if (b < NR_SUB)
+		return b;
+
+	int k = b / NR_SUB + SUB_BITS - 1;
+	uint64_t sub = b % NR_SUB;
+	return ((NR_SUB + sub + 1) << (k - SUB_BITS)) - 1;
+}
+
+/* Run one call of @t->op, and return false if it failed. */
+static bool run_op(struct thread *t, int fd, char *buf)
+{
+	struct stat st;
+
+	switch (t->op) {
+	case BENCH_GETATTR:
+		return fstat(fd, &st) == 0;
+
+	case BENCH_LOOKUP:
+		return stat(t->path, &st) == 0;
+
+	case BENCH_READDIR: {
+		DIR *d = opendir(t->cfg->mntp);
+		if (!d)
+			return false;
+		errno = 0;
+		while (readdir(d))
+			;
+		bool ok = errno == 0;
+		closedir(d);
+		return ok;
+	}
+
+	case BENCH_READ:
+		return pread(fd, buf, READ_SIZE, 0) >= 0;
+
+	default:
+		return false;
+	}
+}
+
+/* Wait for the gate to open, and return false if the run was cancelled. */
+static bool gate_wait(struct gate *g)
+{
+	pthread_mutex_lock(&g->lock);
+	while (!g->open && !g->cancelled)
+		pthread_cond_wait(&g->cond, &g->lock);
+	bool ok = !g->cancelled;
+	pthread_mutex_unlock(&g->lock);
+	return ok;
+}
+
+static void gate_release(struct gate *g, bool cancel)
+{
+	pthread_mutex_lock(&g->lock);
+	g->open = !cancel;
+	g->cancelled = cancel;
+	pthread_cond_broadcast(&g->cond);
+	pthread_mutex_unlock(&g->lock);
+}
+
+static void* run_thread(void *arg)
+{
+	struct thread *t = arg;
+	char *buf = fs_xmalloc(READ_SIZE);
+	bool needs_fd = t->op == BENCH_GETATTR || t->op == BENCH_READ;
+	int fd = -1;
+
+	if (!gate_wait(t->gate))
+		goto out;
+
+	if (needs_fd && (fd = open(t->path, O_RDONLY | O_CLOEXEC)) < 0) {
+		t->nr_errors = 1;
+		goto out;
+	}
+
+	uint64_t deadline = now_ns() + t->cfg->duration_ms * 1000000ull;
+	for (uint64_t start = now_ns(); start < deadline; ) {
+		bool ok = run_op(t, fd, buf);
+		uint64_t end = now_ns();
+		uint64_t ns = end - start;
+
+		++t->nr_ops;
+		if (!ok)
+			++t->nr_errors;
+		t->total_ns += ns;
+		if (ns > t->max_ns)
+			t->max_ns = ns;
+		++t->hist[bucket_of(ns)];
+		start = end;
+	}
+
+out:
+	if (fd >= 0)
+		close(fd);
+	fs_xfree(buf);
+	return NULL;
+}
+
+static uint64_t quantile(const uint64_t *hist, uint64_t count, double q)
+{
+	uint64_t want = (uint64_t)(count * q);
+	uint64_t seen = 0;
+
+	for (int b = 0; b < NR_BUCKETS; ++b) {
+		seen += hist[b];
+		if (seen > want)
+			return bucket_max(b);
+	}
+	return bucket_max(NR_BUCKETS - 1);
+}
+
+static int run(const struct bench_config *cfg, enum bench_op op, const char *path,
+	       struct bench_result *res)
+{
+	int n = cfg->nr_threads;
+	struct thread *threads = fs_xzalloc(n * sizeof(threads[0]));
+	uint64_t *hist = fs_xzalloc(NR_BUCKETS * sizeof(hist[0]));
+	struct gate gate = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, false, false};
+	int nr_started = 0;
+	int r = 0;
+
+	/* Start all threads first, so that thread creation does not eat
+	   into the time of threads that are already running. */
+	for (; nr_started < n; ++nr_started) {
+		struct thread *t = &threads[nr_started];
+		t->cfg = cfg;
+		t->op = op;
+		t->path = path;
+		t->gate = &gate;
+		if ((r = pthread_create(&t->tid, NULL, run_thread, t)) != 0)
+			break;
+	}
+
+	uint64_t begin = now_ns();
+	gate_release(&gate, r != 0);
+
+	memset(res, 0, sizeof(*res));
+	for (int i = 0; i < nr_started; ++i) {
+		struct thread *t = &threads[i];
+		pthread_join(t->tid, NULL);
+
+		res->nr_ops += t->nr_ops;
+		res->nr_errors += t->nr_errors;
+		res->total_ns += t->total_ns;
+		if (t->max_ns > res->max_ns)
+			res->max_ns = t->max_ns;
+		for (int b = 0; b < NR_BUCKETS; ++b)
+			hist[b] += t->hist[b];
+	}
+	res->elapsed_ns = now_ns() - begin;
+	res->p50_ns = quantile(hist, res->nr_ops, 0.5);
+	res->p99_ns = quantile(hist, res->nr_ops, 0.99);
+	res->p999_ns = quantile(hist, res->nr_ops, 0.999);
+
+	pthread_cond_destroy(&gate.cond);
+	pthread_mutex_destroy(&gate.lock);
+	fs_xfree(hist);
+	fs_xfree(threads);
+	return -r;
+}
+
+int fuse_bench(const struct bench_config *cfg, struct bench_result res[NR_BENCH_OPS])
+{
+	struct fs_strbuf path = FS_STRBUF_INIT;
+	struct stat st;
+	int r = 0;
+
+	if (cfg->nr_threads <= 0)
+		return -EINVAL;
+
+	fs_strbuf_appends(&path, cfg->mntp);
+	fs_strbuf_push_path(&path, cfg->file);
+	if (stat(path.s, &st) < 0) {
+		r = -errno;
+		goto out;
+	}
+	if (!S_ISREG(st.st_mode)) {
+		r = -EINVAL;
+		goto out;
+	}
+
+	for (int op = 0; op < NR_BENCH_OPS; ++op) {
+		if (!(cfg->ops & (1u << op)))
+			continue;
+		if ((r = run(cfg, op, path.s, &res[op])) < 0)
+			break;
+	}
+
+out:
+	fs_strbuf_free(&path);
+	return r;
+}
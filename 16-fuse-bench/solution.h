@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+
+enum bench_op
+{
+	/* fstat() of an open file. */
+	BENCH_GETATTR,
+	/* stat() of a file by its path. */
+	BENCH_LOOKUP,
+	/* opendir(), readdir() to the end and closedir() of the mount point. */
+	BENCH_READDIR,
+	/* A 4 KiB pread() at offset 0 of an open file. */
+	BENCH_READ,
+	NR_BENCH_OPS,
+};
+
+struct bench_config
+{
+	const char *mntp;
+	/* A file under @mntp to stat and read. */
+	const char *file;
+	int nr_threads;
+	unsigned duration_ms;
+	/* A mask of (1 << BENCH_*) operations to run. */
+	unsigned ops;
+};
+
+struct bench_result
+{
+	uint64_t nr_ops;
+	uint64_t nr_errors;
+	/* The wall time of the run. */
+	uint64_t elapsed_ns;
+	/* Latencies, the sum of all and the quantiles. Quantiles are
+	   accurate to about 6%. */
+	uint64_t total_ns;
+	uint64_t p50_ns;
+	uint64_t p99_ns;
+	uint64_t p999_ns;
+	uint64_t max_ns;
+};
+
+/**
+   Run every operation in @cfg->ops from @cfg->nr_threads threads for
+   @cfg->duration_ms against a mounted filesystem, one operation after
+   another, and fill @res for each of them.
+
+   The mounted filesystem should disable attribute and entry caching,
+   otherwise most calls are served by the kernel alone.
+
+   Return 0 if successful, or -errno if the mount could not be set up
+   for a run. Errors of individual calls are counted in @res.
+*/
+int fuse_bench(const struct bench_config *cfg, struct bench_result res[NR_BENCH_OPS]);
+
+const char* bench_op_name(enum bench_op op);
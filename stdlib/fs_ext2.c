@@ -0,0 +1,563 @@
+#include <fs_ext2.h>
+#include <fs_malloc.h>
+
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <err.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+/* The number of directory blocks fetched at once. */
+#define WINDOW_BLOCKS 256
+/* A window is read with one preadv() if it has at most this many runs... */
+#define MAX_RUNS 16
+/* ...and the gaps between them are no longer than the window itself. */
+#define MAX_GAP_RATIO 1
+
+int fs_ext2_pread(const struct fs_ext2 *fs, void *buf, size_t len, uint64_t off)
+{
+	while (len > 0) {
+		ssize_t n = pread(fs->img, buf, len, off);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		if (n == 0)
+			return -EIO;
+		buf = (char *)buf + n;
+		len -= n;
+		off += n;
+	}
+	return 0;
+}
+
+int fs_ext2_load(struct fs_ext2 *fs, int img)
+{
+	fs->img = img;
+
+	int r = fs_ext2_pread(fs, &fs->sb, sizeof(fs->sb), EXT2_SUPERBLOCK_OFFSET);
+	if (r < 0)
+		return r;
+
+	if (fs->sb.s_magic != EXT2_SUPER_MAGIC || fs->sb.s_log_block_size > 6 ||
+	    fs->sb.s_blocks_per_group == 0 || fs->sb.s_inodes_per_group == 0)
+		return -EIO;
+
+	fs->block_size = 1024u << fs->sb.s_log_block_size;
+	fs->inode_size = fs->sb.s_rev_level == EXT2_GOOD_OLD_REV ?
+		EXT2_GOOD_OLD_INODE_SIZE : fs->sb.s_inode_size;
+	if (fs->inode_size < EXT2_GOOD_OLD_INODE_SIZE || fs->inode_size > fs->block_size ||
+	    fs->block_size % fs->inode_size)
+		return -EIO;
+
+	fs->nr_groups = (fs->sb.s_blocks_count - fs->sb.s_first_data_block +
+			 fs->sb.s_blocks_per_group - 1) / fs->sb.s_blocks_per_group;
+	fs->gdt = fs_xmalloc(fs->nr_groups * sizeof(fs->gdt[0]));
+	r = fs_ext2_pread(fs, fs->gdt, fs->nr_groups * sizeof(fs->gdt[0]),
+			  (uint64_t)(fs->sb.s_first_data_block + 1) * fs->block_size);
+	if (r < 0) {
+		fs_xfree(fs->gdt);
+		return r;
+	}
+	return 0;
+}
+
+void fs_ext2_free(struct fs_ext2 *fs)
+{
+	fs_xfree(fs->gdt);
+}
+
+int fs_ext2_read_inode(const struct fs_ext2 *fs, uint32_t ino, struct ext2_inode *inode)
+{
+	if (ino == 0 || ino > fs->sb.s_inodes_count)
+		return -EIO;
+
+	uint32_t group = (ino - 1) / fs->sb.s_inodes_per_group;
+	uint32_t index = (ino - 1) % fs->sb.s_inodes_per_group;
+	if (group >= fs->nr_groups)
+		return -EIO;
+
+	uint64_t off = (uint64_t)fs->gdt[group].bg_inode_table * fs->block_size +
+		(uint64_t)index * fs->inode_size;
+	return fs_ext2_pread(fs, inode, sizeof(*inode), off);
+}
+
+uint64_t fs_ext2_inode_size(const struct fs_ext2 *fs, const struct ext2_inode *inode)
+{
+	uint64_t size = inode->i_size;
+	if (S_ISREG(inode->i_mode) && fs->sb.s_feature_ro_compat & EXT2_FEATURE_RO_COMPAT_LARGE_FILE)
+		size |= (uint64_t)inode->i_size_high << 32;
+	return size;
+}
+
+void fs_ext2_blkmap_init(struct fs_ext2_blkmap *m, const struct fs_ext2 *fs,
+			 const struct ext2_inode *inode)
+{
+	memset(m, 0, sizeof(*m));
+	m->fs = fs;
+	m->inode = inode;
+	for (int i = 0; i < 3; ++i)
+		m->cached[i] = fs_xmalloc(fs->block_size);
+}
+
+void fs_ext2_blkmap_free(struct fs_ext2_blkmap *m)
+{
+	for (int i = 0; i < 3; ++i)
+		fs_xfree(m->cached[i]);
+}
+
+/* Read the @idx-th pointer of an indirect block @blk at @level. */
+static int read_ptr(struct fs_ext2_blkmap *m, int level, uint32_t blk, uint32_t idx, uint32_t *out)
+{
+	if (blk == 0) {
+		*out = 0;
+		return 0;
+	}
+	if (blk >= m->fs->sb.s_blocks_count)
+		return -EIO;
+
+	if (m->cached_nr[level] != blk) {
+		int r = fs_ext2_pread(m->fs, m->cached[level], m->fs->block_size,
+				      (uint64_t)blk * m->fs->block_size);
+		if (r < 0) {
+			m->cached_nr[level] = 0;
+			return r;
+		}
+		m->cached_nr[level] = blk;
+	}
+	*out = m->cached[level][idx];
+	return 0;
+}
+
+int fs_ext2_blkmap_get(struct fs_ext2_blkmap *m, uint64_t lbn, uint32_t *pbn)
+{
+	const uint32_t *b = m->inode->i_block;
+	uint64_t per = m->fs->block_size / sizeof(uint32_t);
+	uint32_t x;
+	int r;
+
+	if (lbn < EXT2_NDIR_BLOCKS) {
+		x = b[lbn];
+	} else if ((lbn -= EXT2_NDIR_BLOCKS) < per) {
+		r = read_ptr(m, 0, b[EXT2_IND_BLOCK], lbn, &x);
+		if (r < 0)
+			return r;
+	} else if ((lbn -= per) < per * per) {
+		if ((r = read_ptr(m, 1, b[EXT2_DIND_BLOCK], lbn / per, &x)) < 0 ||
+		    (r = read_ptr(m, 0, x, lbn % per, &x)) < 0)
+			return r;
+	} else if ((lbn -= per * per) < per * per * per) {
+		if ((r = read_ptr(m, 2, b[EXT2_TIND_BLOCK], lbn / (per * per), &x)) < 0 ||
+		    (r = read_ptr(m, 1, x, lbn / per % per, &x)) < 0 ||
+		    (r = read_ptr(m, 0, x, lbn % per, &x)) < 0)
+			return r;
+	} else {
+		return -EFBIG;
+	}
+
+	if (x >= m->fs->sb.s_blocks_count)
+		return -EIO;
+	*pbn = x;
+	return 0;
+}
+
+struct run_walk
+{
+	const struct fs_ext2 *fs;
+	uint64_t nr_blocks;
+	int (*report)(const struct fs_ext2_run *run, void *arg);
+	void *arg;
+
+	/* The run being extended, reported once a block does not fit. */
+	struct fs_ext2_run run;
+	/* An indirect block being scanned at each level. */
+	uint32_t *ind[3];
+};
+
+static int add_block(struct run_walk *w, uint64_t lbn, uint32_t pbn)
+{
+	if (pbn >= w->fs->sb.s_blocks_count)
+		return -EIO;
+
+	struct fs_ext2_run *run = &w->run;
+	if (run->len && run->lbn + run->len == lbn && run->pbn + run->len == pbn &&
+	    run->len < UINT32_MAX) {
+		++run->len;
+		return 0;
+	}
+	if (run->len) {
+		int r = w->report(run, w->arg);
+		if (r < 0)
+			return r;
+	}
+	*run = (struct fs_ext2_run){lbn, pbn, 1};
+	return 0;
+}
+
+/* Walk an indirect block @blk at @level, 0 for one that points to data
+   blocks, whose first pointer maps logical block @lbn. */
+static int walk_ind(struct run_walk *w, int level, uint32_t blk, uint64_t lbn)
+{
+	size_t bs = w->fs->block_size;
+	uint64_t per = bs / sizeof(uint32_t);
+	uint64_t span = 1;
+	int r;
+
+	for (int i = 0; i < level; ++i)
+		span *= per;
+
+	if (blk >= w->fs->sb.s_blocks_count)
+		return -EIO;
+	if ((r = fs_ext2_pread(w->fs, w->ind[level], bs, (uint64_t)blk * bs)) < 0)
+		return r;
+
+	for (uint64_t i = 0; i < per && lbn < w->nr_blocks; ++i, lbn += span) {
+		uint32_t x = w->ind[level][i];
+		if (x == 0)
+			continue;
+
+		r = level ? walk_ind(w, level - 1, x, lbn) : add_block(w, lbn, x);
+		if (r < 0)
+			return r;
+	}
+	return 0;
+}
+
+int fs_ext2_walk_runs(const struct fs_ext2 *fs, const struct ext2_inode *inode, uint64_t nr_blocks,
+		      int (*report)(const struct fs_ext2_run *run, void *arg), void *arg)
+{
+	const uint32_t *b = inode->i_block;
+	uint64_t per = fs->block_size / sizeof(uint32_t);
+	int r = 0;
+
+	if (nr_blocks > EXT2_NDIR_BLOCKS + per + per * per + per * per * per)
+		return -EFBIG;
+
+	struct run_walk w = {
+		.fs = fs,
+		.nr_blocks = nr_blocks,
+		.report = report,
+		.arg = arg,
+	};
+	for (int i = 0; i < 3; ++i)
+		w.ind[i] = fs_xmalloc(fs->block_size);
+
+	for (uint64_t lbn = 0; lbn < EXT2_NDIR_BLOCKS && lbn < nr_blocks && r == 0; ++lbn) {
+		if (b[lbn])
+			r = add_block(&w, lbn, b[lbn]);
+	}
+
+	uint64_t lbn = EXT2_NDIR_BLOCKS;
+	uint64_t span = per;
+	for (int level = 0; level < 3 && lbn < nr_blocks && r == 0; ++level) {
+		if (b[EXT2_IND_BLOCK + level])
+			r = walk_ind(&w, level, b[EXT2_IND_BLOCK + level], lbn);
+		lbn += span;
+		span *= per;
+	}
+
+	if (r == 0 && w.run.len)
+		r = report(&w.run, arg);
+
+	for (int i = 0; i < 3; ++i)
+		fs_xfree(w.ind[i]);
+	return r;
+}
+
+/*
+   Read @n blocks @pbns into consecutive block-sized slots of @buf.
+   If the blocks form a few ascending runs with short gaps, the whole
+   span is read with one preadv(), and gaps land in @junk.
+ */
+static int read_window(const struct fs_ext2 *fs, const uint32_t *pbns, size_t n,
+		       char *buf, char *junk)
+{
+	size_t bs = fs->block_size;
+	size_t nr_runs = 1;
+	bool ascending = true;
+
+	for (size_t i = 1; i < n; ++i) {
+		if (pbns[i] != pbns[i - 1] + 1)
+			++nr_runs;
+		if (pbns[i] <= pbns[i - 1])
+			ascending = false;
+	}
+
+	uint64_t span = (uint64_t)pbns[n - 1] - pbns[0] + 1;
+	if (ascending && nr_runs <= MAX_RUNS && span <= n * (1 + MAX_GAP_RATIO)) {
+		struct iovec iov[2 * MAX_RUNS];
+		size_t cnt = 0;
+		size_t start = 0;
+
+		for (size_t i = 1; i <= n; ++i) {
+			if (i < n && pbns[i] == pbns[i - 1] + 1)
+				continue;
+
+			iov[cnt++] = (struct iovec){buf + start * bs, (i - start) * bs};
+			if (i < n) {
+				size_t gap = pbns[i] - pbns[i - 1] - 1;
+				if (gap)
+					iov[cnt++] = (struct iovec){junk, gap * bs};
+			}
+			start = i;
+		}
+
+		off_t off = (off_t)pbns[0] * bs;
+		size_t want = span * bs;
+		ssize_t got;
+		do {
+			got = preadv(fs->img, iov, cnt, off);
+		} while (got < 0 && errno == EINTR);
+
+		if (got < 0)
+			return -errno;
+		if ((size_t)got == want)
+			return 0;
+		/* A short read, fall back to reading runs one by one. */
+	}
+
+	size_t start = 0;
+	for (size_t i = 1; i <= n; ++i) {
+		if (i < n && pbns[i] == pbns[i - 1] + 1)
+			continue;
+
+		int r = fs_ext2_pread(fs, buf + start * bs, (i - start) * bs,
+				      (uint64_t)pbns[start] * bs);
+		if (r < 0)
+			return r;
+		start = i;
+	}
+	return 0;
+}
+
+/* Parse a directory block into @entries, copying names to @names. */
+static int parse_block(const struct fs_ext2 *fs, const char *block,
+		       struct fs_ext2_dirent *entries, size_t *n, char *names)
+{
+	size_t bs = fs->block_size;
+	size_t nr = 0;
+
+	for (size_t off = 0; off < bs; ) {
+		const struct ext2_dir_entry *de = (const void *)(block + off);
+		if (bs - off < sizeof(*de) || de->rec_len < sizeof(*de) ||
+		    de->rec_len % 4 || de->rec_len > bs - off ||
+		    de->name_len > de->rec_len - sizeof(*de))
+			return -EIO;
+
+		if (de->inode) {
+			struct fs_ext2_dirent *e = &entries[nr++];
+			e->inode_nr = de->inode;
+			e->file_type = fs->sb.s_feature_incompat & EXT2_FEATURE_INCOMPAT_FILETYPE ?
+				de->file_type : EXT2_FT_UNKNOWN;
+			memcpy(names, de->name, de->name_len);
+			names[de->name_len] = '\0';
+			e->name = names;
+			names += de->name_len + 1;
+		}
+		off += de->rec_len;
+	}
+
+	*n = nr;
+	return 0;
+}
+
+/* Buffers of fs_ext2_read_dir(), kept by each thread between calls so that
+   walking many directories does not allocate for every one of them. They
+   are freed when the thread exits. */
+struct dir_buffers
+{
+	struct fs_ext2_dirent *entries;
+	size_t entries_cap;
+	char *names;
+	size_t names_cap;
+	char *window;
+	size_t window_cap;
+	char *junk;
+	size_t junk_cap;
+};
+
+static pthread_once_t dir_buffers_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t dir_buffers_key;
+static __thread struct dir_buffers *dir_buffers;
+
+static void free_dir_buffers(void *arg)
+{
+	struct dir_buffers *b = arg;
+
+	fs_xfree(b->entries);
+	fs_xfree(b->names);
+	fs_xfree(b->window);
+	fs_xfree(b->junk);
+	fs_xfree(b);
+	dir_buffers = NULL;
+}
+
+static void create_dir_buffers_key(void)
+{
+	if (pthread_key_create(&dir_buffers_key, free_dir_buffers) != 0)
+		errx(1, "failed to create the directory buffers key");
+}
+
+static struct dir_buffers* local_dir_buffers(void)
+{
+	if (dir_buffers)
+		return dir_buffers;
+
+	pthread_once(&dir_buffers_key_once, create_dir_buffers_key);
+	dir_buffers = fs_xzalloc(sizeof(*dir_buffers));
+	pthread_setspecific(dir_buffers_key, dir_buffers);
+	return dir_buffers;
+}
+
+/* Return @buf if its @cap is at least @size bytes, or a new buffer.
+   The content is not kept. */
+static void* reserve(void *buf, size_t *cap, size_t size)
+{
+	if (size <= *cap)
+		return buf;
+
+	fs_xfree(buf);
+	*cap = size;
+	return fs_xmalloc(size);
+}
+
+int fs_ext2_read_dir(const struct fs_ext2 *fs, const struct ext2_inode *dir,
+		     int (*report)(const struct fs_ext2_dirent *entries, size_t n, void *arg),
+		     void *arg)
+{
+	if (!S_ISDIR(dir->i_mode))
+		return -ENOTDIR;
+
+	size_t bs = fs->block_size;
+	uint64_t nr_blocks = ((uint64_t)dir->i_size + bs - 1) / bs;
+	int r = 0;
+
+	size_t window_blocks = nr_blocks < WINDOW_BLOCKS ? nr_blocks : WINDOW_BLOCKS;
+	struct dir_buffers *b = local_dir_buffers();
+
+	/* Every entry has an 8-byte header, so a block has room for at most
+	   bs / 8 entries, and the names with their NULs take at most bs bytes.
+	   A gap of a window is never longer than MAX_GAP_RATIO windows. */
+	struct fs_ext2_dirent *entries = b->entries =
+		reserve(b->entries, &b->entries_cap, bs / 8 * sizeof(entries[0]));
+	char *names = b->names = reserve(b->names, &b->names_cap, bs);
+	char *window = b->window = reserve(b->window, &b->window_cap, window_blocks * bs);
+	char *junk = b->junk = reserve(b->junk, &b->junk_cap, window_blocks * MAX_GAP_RATIO * bs);
+	uint32_t pbns[WINDOW_BLOCKS];
+
+	struct fs_ext2_blkmap m;
+	fs_ext2_blkmap_init(&m, fs, dir);
+
+	for (uint64_t lbn = 0; lbn < nr_blocks && r == 0; ) {
+		size_t n = 0;
+		for (; n < WINDOW_BLOCKS && lbn < nr_blocks; ++n, ++lbn) {
+			if ((r = fs_ext2_blkmap_get(&m, lbn, &pbns[n])) < 0)
+				break;
+			/* Directories are never sparse. */
+			if (pbns[n] == 0) {
+				r = -EIO;
+				break;
+			}
+		}
+		if (r < 0)
+			break;
+
+		if ((r = read_window(fs, pbns, n, window, junk)) < 0)
+			break;
+
+		for (size_t i = 0; i < n; ++i) {
+			size_t nr;
+			if ((r = parse_block(fs, window + i * bs, entries, &nr, names)) < 0)
+				break;
+			if (nr && (r = report(entries, nr, arg)) < 0)
+				break;
+		}
+	}
+
+	fs_ext2_blkmap_free(&m);
+	return r;
+}
+
+int fs_ext2_readlink(const struct fs_ext2 *fs, const struct ext2_inode *inode, struct fs_strbuf *b)
+{
+	size_t len = inode->i_size;
+
+	fs_strbuf_clear(b);
+	fs_strbuf_reserve(b, len);
+
+	/* A fast symlink keeps its target in i_block and has no data blocks. */
+	uint32_t acl_blocks = inode->i_file_acl ? fs->block_size / 512 : 0;
+	if (inode->i_blocks == acl_blocks) {
+		if (len > sizeof(inode->i_block))
+			return -EIO;
+		memcpy(b->s, inode->i_block, len);
+	} else {
+		uint32_t blk = inode->i_block[0];
+		if (len > fs->block_size || blk == 0 || blk >= fs->sb.s_blocks_count)
+			return -EIO;
+		int r = fs_ext2_pread(fs, b->s, len, (uint64_t)blk * fs->block_size);
+		if (r < 0)
+			return r;
+	}
+
+	b->len = len;
+	b->s[len] = '\0';
+	return 0;
+}
+
+struct lookup
+{
+	const char *name;
+	size_t len;
+	uint32_t ino;
+};
+
+static int match_entries(const struct fs_ext2_dirent *entries, size_t n, void *arg)
+{
+	struct lookup *l = arg;
+
+	for (size_t i = 0; i < n && l->ino == 0; ++i) {
+		if (strlen(entries[i].name) == l->len &&
+		    memcmp(entries[i].name, l->name, l->len) == 0)
+			l->ino = entries[i].inode_nr;
+	}
+	return 0;
+}
+
+int fs_ext2_lookup(const struct fs_ext2 *fs, const char *path,
+		   uint32_t *ino, struct ext2_inode *inode)
+{
+	uint32_t cur = EXT2_ROOT_INO;
+	int r;
+
+	if ((r = fs_ext2_read_inode(fs, cur, inode)) < 0)
+		return r;
+
+	for (;;) {
+		while (*path == '/')
+			++path;
+		if (*path == '\0')
+			break;
+
+		struct lookup l = {path, strcspn(path, "/"), 0};
+		path += l.len;
+
+		if (l.len > EXT2_NAME_LEN)
+			return -ENAMETOOLONG;
+		if ((r = fs_ext2_read_dir(fs, inode, match_entries, &l)) < 0)
+			return r;
+		if (l.ino == 0)
+			return -ENOENT;
+
+		cur = l.ino;
+		if ((r = fs_ext2_read_inode(fs, cur, inode)) < 0)
+			return r;
+	}
+
+	*ino = cur;
+	return 0;
+}
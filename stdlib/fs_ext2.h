@@ -0,0 +1,105 @@
+#pragma once
+
+#include <ext2.h>
+#include <fs_string.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+   A read-only view of an ext2 image. All functions are safe to call
+   from several threads at once, they only pread() from the image.
+ */
+struct fs_ext2
+{
+	int img;
+	struct ext2_super_block sb;
+	uint32_t block_size;
+	uint32_t inode_size;
+	uint32_t nr_groups;
+	struct ext2_group_desc *gdt;
+};
+
+/* Read the superblock and the group descriptors of an image @img, which
+   stays owned by the caller. Fail with -EIO if they make no sense. */
+int fs_ext2_load(struct fs_ext2 *fs, int img);
+void fs_ext2_free(struct fs_ext2 *fs);
+
+/* Read an exact number of bytes at @off, and fail with -EIO at EOF. */
+int fs_ext2_pread(const struct fs_ext2 *fs, void *buf, size_t len, uint64_t off);
+
+int fs_ext2_read_inode(const struct fs_ext2 *fs, uint32_t ino, struct ext2_inode *inode);
+
+/* Return the size of an inode, including the high 32 bits for regular files. */
+uint64_t fs_ext2_inode_size(const struct fs_ext2 *fs, const struct ext2_inode *inode);
+
+/*
+   Maps logical blocks of an inode to physical ones. The last indirect
+   block seen at each level is kept, so a sequential scan reads every
+   indirect block once.
+ */
+struct fs_ext2_blkmap
+{
+	const struct fs_ext2 *fs;
+	const struct ext2_inode *inode;
+
+	uint32_t cached_nr[3];
+	uint32_t *cached[3];
+};
+
+void fs_ext2_blkmap_init(struct fs_ext2_blkmap *m, const struct fs_ext2 *fs,
+			 const struct ext2_inode *inode);
+void fs_ext2_blkmap_free(struct fs_ext2_blkmap *m);
+
+/* Map a logical block @lbn to a physical one, 0 for a hole. */
+int fs_ext2_blkmap_get(struct fs_ext2_blkmap *m, uint64_t lbn, uint32_t *pbn);
+
+/* @len logical blocks from @lbn on, mapped to physical blocks from @pbn on. */
+struct fs_ext2_run
+{
+	uint64_t lbn;
+	uint32_t pbn;
+	uint32_t len;
+};
+
+/*
+   Call @report for every run of allocated blocks among the first
+   @nr_blocks logical blocks of @inode, in the logical order. A zero
+   pointer to an indirect block skips its whole subtree, so holes cost
+   nothing, however large. A negative return of @report stops the walk.
+ */
+int fs_ext2_walk_runs(const struct fs_ext2 *fs, const struct ext2_inode *inode, uint64_t nr_blocks,
+		      int (*report)(const struct fs_ext2_run *run, void *arg), void *arg);
+
+/*
+   A directory entry. @name is NUL-terminated and is only valid during
+   a callback. @file_type is one of EXT2_FT_*, and EXT2_FT_UNKNOWN if the
+   image does not record types in directories.
+ */
+struct fs_ext2_dirent
+{
+	uint32_t inode_nr;
+	uint8_t file_type;
+	const char *name;
+};
+
+/*
+   Call @report once per directory block of @dir with an array of @n
+   entries found in that block, in the on-disk order. A negative return
+   of @report stops the walk.
+
+   Directory blocks are fetched in windows of up to 256 blocks. A window
+   that maps to a few runs of blocks on the disk is read with a single
+   preadv(). Buffers are sized by the directory, and each thread keeps
+   them between calls, so @report must not read directories itself.
+ */
+int fs_ext2_read_dir(const struct fs_ext2 *fs, const struct ext2_inode *dir,
+		     int (*report)(const struct fs_ext2_dirent *entries, size_t n, void *arg),
+		     void *arg);
+
+/* Replace the content of @b with the target of a symlink @inode. */
+int fs_ext2_readlink(const struct fs_ext2 *fs, const struct ext2_inode *inode, struct fs_strbuf *b);
+
+/* Resolve an absolute @path into an inode number and its inode. */
+int fs_ext2_lookup(const struct fs_ext2 *fs, const char *path,
+		   uint32_t *ino, struct ext2_inode *inode);
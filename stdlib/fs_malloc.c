@@ -1,33 +1,265 @@
 #include <fs_malloc.h>
 
-#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <string.h>
+#include <malloc.h>
 #include <err.h>
 
-void* fs_xmalloc(size_t size)
+#define NR_SITES 1024
+
+static bool stats_enabled;
+
+static struct fs_malloc_stats stats;
+
+/* An open-addressing table of call sites, and a spinlock that guards it. */
+static struct fs_malloc_site sites[NR_SITES];
+static int sites_lock;
+
+static struct fs_malloc_site *site_find(const char *file, int line)
+{
+	uintptr_t h = ((uintptr_t)file >> 3) * 31 + (uintptr_t)line;
+
+	for (size_t i = 0; i < NR_SITES; ++i) {
+		struct fs_malloc_site *s = &sites[(h + i) % NR_SITES];
+		if (s->file == file && s->line == line)
+			return s;
+		if (s->file == NULL) {
+			s->file = file;
+			s->line = line;
+			return s;
+		}
+	}
+	return NULL;
+}
+
+static void account_alloc(void *x, const char *file, int line)
+{
+	size_t size = malloc_usable_size(x);
+
+	__atomic_fetch_add(&stats.nr_allocs, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&stats.bytes, size, __ATOMIC_RELAXED);
+
+	size_t live = __atomic_add_fetch(&stats.live_bytes, size, __ATOMIC_RELAXED);
+	size_t peak = __atomic_load_n(&stats.peak_bytes, __ATOMIC_RELAXED);
+	while (live > peak &&
+	       !__atomic_compare_exchange_n(&stats.peak_bytes, &peak, live, true,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+
+	while (__atomic_exchange_n(&sites_lock, 1, __ATOMIC_ACQUIRE))
+		;
+	struct fs_malloc_site *s = site_find(file, line);
+	if (s) {
+		s->nr_allocs++;
+		s->bytes += size;
+	}
+	__atomic_store_n(&sites_lock, 0, __ATOMIC_RELEASE);
+}
+
+static void account_free(void *x)
+{
+	size_t size = malloc_usable_size(x);
+
+	__atomic_fetch_add(&stats.nr_frees, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_sub(&stats.live_bytes, size, __ATOMIC_RELAXED);
+}
+
+void* fs_xmalloc_at(size_t size, const char *file, int line)
 {
 	void *x = malloc(size);
 	if (x == NULL)
 		errx(1, "malloc() failed");
+	if (__atomic_load_n(&stats_enabled, __ATOMIC_RELAXED))
+		account_alloc(x, file, line);
 	return x;
 }
 
-void* fs_xzalloc(size_t size)
+void* fs_xzalloc_at(size_t size, const char *file, int line)
 {
-	void *x = fs_xmalloc(size);
+	void *x = fs_xmalloc_at(size, file, line);
 	memset(x, 0, size);
 	return x;
 }
 
-void* fs_xrealloc(void *x, size_t size)
+void* fs_xrealloc_at(void *x, size_t size, const char *file, int line)
 {
+	bool enabled = __atomic_load_n(&stats_enabled, __ATOMIC_RELAXED);
+	if (enabled && x)
+		account_free(x);
+
 	x = realloc(x, size);
 	if (x == NULL)
 		errx(1, "realloc() failed");
+
+	if (enabled)
+		account_alloc(x, file, line);
 	return x;
 }
 
 void fs_xfree(void *x)
 {
+	if (x && __atomic_load_n(&stats_enabled, __ATOMIC_RELAXED))
+		account_free(x);
 	free(x);
 }
+
+void fs_malloc_stats_enable(int enable)
+{
+	__atomic_store_n(&stats_enabled, enable != 0, __ATOMIC_RELAXED);
+}
+
+void fs_malloc_stats_reset(void)
+{
+	while (__atomic_exchange_n(&sites_lock, 1, __ATOMIC_ACQUIRE))
+		;
+	memset(sites, 0, sizeof(sites));
+	/* Blocks that are still live will be freed later, so keep
+	   the count of live bytes. */
+	size_t live = __atomic_load_n(&stats.live_bytes, __ATOMIC_RELAXED);
+	__atomic_store_n(&stats.nr_allocs, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&stats.nr_frees, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&stats.bytes, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&stats.peak_bytes, live, __ATOMIC_RELAXED);
+	__atomic_store_n(&sites_lock, 0, __ATOMIC_RELEASE);
+}
+
+void fs_malloc_stats_get(struct fs_malloc_stats *out)
+{
+	out->nr_allocs = __atomic_load_n(&stats.nr_allocs, __ATOMIC_RELAXED);
+	out->nr_frees = __atomic_load_n(&stats.nr_frees, __ATOMIC_RELAXED);
+	out->bytes = __atomic_load_n(&stats.bytes, __ATOMIC_RELAXED);
+	out->live_bytes = __atomic_load_n(&stats.live_bytes, __ATOMIC_RELAXED);
+	out->peak_bytes = __atomic_load_n(&stats.peak_bytes, __ATOMIC_RELAXED);
+}
+
+void fs_malloc_stats_foreach_site(void (*cb)(const struct fs_malloc_site *site, void *arg),
+				  void *arg)
+{
+	while (__atomic_exchange_n(&sites_lock, 1, __ATOMIC_ACQUIRE))
+		;
+	struct fs_malloc_site *copy = malloc(sizeof(sites));
+	if (copy)
+		memcpy(copy, sites, sizeof(sites));
+	__atomic_store_n(&sites_lock, 0, __ATOMIC_RELEASE);
+
+	if (copy == NULL)
+		errx(1, "malloc() failed");
+
+	for (size_t i = 0; i < NR_SITES; ++i) {
+		if (copy[i].file)
+			cb(&copy[i], arg);
+	}
+	free(copy);
+}
+
+static void print_site(const struct fs_malloc_site *s, void *arg)
+{
+	(void) arg;
+	fprintf(stderr, "  %s:%d: %zu allocs, %zu bytes\n",
+		s->file, s->line, s->nr_allocs, s->bytes);
+}
+
+static void print_stats(void)
+{
+	struct fs_malloc_stats s;
+	fs_malloc_stats_get(&s);
+
+	fprintf(stderr, "fs_malloc: %zu allocs, %zu frees, %zu bytes, %zu live, %zu peak\n",
+		s.nr_allocs, s.nr_frees, s.bytes, s.live_bytes, s.peak_bytes);
+	fs_malloc_stats_foreach_site(print_site, NULL);
+}
+
+__attribute__((constructor))
+static void stats_init(void)
+{
+	const char *x = getenv("FS_MALLOC_STATS");
+	if (x == NULL || x[0] == '\0' || strcmp(x, "0") == 0)
+		return;
+
+	fs_malloc_stats_enable(1);
+	atexit(print_stats);
+}
+
+#define ARENA_CHUNK_SIZE (64 << 10)
+
+struct fs_arena_chunk
+{
+	struct fs_arena_chunk *prev;
+	size_t size;
+	max_align_t data[];
+};
+
+void fs_arena_init(struct fs_arena *a, size_t chunk_size)
+{
+	memset(a, 0, sizeof(*a));
+	a->chunk_size = chunk_size ? chunk_size : ARENA_CHUNK_SIZE;
+}
+
+static void arena_grow(struct fs_arena *a, size_t size, const char *file, int line)
+{
+	struct fs_arena_chunk *c = NULL;
+
+	if (size <= a->chunk_size) {
+		size = a->chunk_size;
+		if (a->spare) {
+			c = a->spare;
+			a->spare = NULL;
+		}
+	}
+	if (c == NULL) {
+		c = fs_xmalloc_at(sizeof(*c) + size, file, line);
+		c->size = size;
+	}
+
+	c->prev = a->chunk;
+	a->chunk = c;
+	a->used = 0;
+}
+
+void* fs_arena_alloc_at(struct fs_arena *a, size_t size, const char *file, int line)
+{
+	const size_t align = _Alignof(max_align_t);
+	size = (size + align - 1) & ~(align - 1);
+
+	if (a->chunk == NULL || a->chunk->size - a->used < size)
+		arena_grow(a, size, file, line);
+
+	void *x = (char *)a->chunk->data + a->used;
+	a->used += size;
+	return x;
+}
+
+void* fs_arena_zalloc_at(struct fs_arena *a, size_t size, const char *file, int line)
+{
+	void *x = fs_arena_alloc_at(a, size, file, line);
+	memset(x, 0, size);
+	return x;
+}
+
+struct fs_arena_mark fs_arena_mark(const struct fs_arena *a)
+{
+	return (struct fs_arena_mark){.chunk = a->chunk, .used = a->used};
+}
+
+void fs_arena_reset(struct fs_arena *a, struct fs_arena_mark mark)
+{
+	while (a->chunk != mark.chunk) {
+		struct fs_arena_chunk *c = a->chunk;
+		a->chunk = c->prev;
+
+		if (a->spare == NULL && c->size == a->chunk_size)
+			a->spare = c;
+		else
+			fs_xfree(c);
+	}
+	a->used = mark.used;
+}
+
+void fs_arena_release(struct fs_arena *a)
+{
+	fs_arena_reset(a, (struct fs_arena_mark){0});
+	fs_xfree(a->spare);
+	a->spare = NULL;
+}
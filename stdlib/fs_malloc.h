@@ -1,17 +1,103 @@
 #pragma once
 
 #include <stdlib.h>
+#include <stddef.h>
 
 /* A version of malloc() that panics if an allocation fails. */
-void* fs_xmalloc(size_t size) __attribute__((malloc));
+#define fs_xmalloc(size) fs_xmalloc_at((size), __FILE__, __LINE__)
+void* fs_xmalloc_at(size_t size, const char *file, int line) __attribute__((malloc));
 
 /* A version of malloc() that returns zero-initialised memory
    and panics if an allocation fails. */
-void* fs_xzalloc(size_t size) __attribute__((malloc));
+#define fs_xzalloc(size) fs_xzalloc_at((size), __FILE__, __LINE__)
+void* fs_xzalloc_at(size_t size, const char *file, int line) __attribute__((malloc));
 
 /* A version of realloc() that panics if an allocation fails. */
-void* fs_xrealloc(void *x, size_t size);
+#define fs_xrealloc(x, size) fs_xrealloc_at((x), (size), __FILE__, __LINE__)
+void* fs_xrealloc_at(void *x, size_t size, const char *file, int line);
 
 /* A version of free() to be used to deallocate blocks returned by
    fs_x*alloc(). */
 void fs_xfree(void *x);
+
+/*
+   Allocation statistics. They are off by default, and are turned on
+   either by fs_malloc_stats_enable() or by setting FS_MALLOC_STATS=1
+   in the environment. In the latter case a report is printed to stderr
+   at exit. Byte counts are in terms of malloc_usable_size(). Turn the
+   statistics on before allocating, or the live byte count will be off
+   by blocks that were allocated unaccounted and then freed.
+ */
+struct fs_malloc_stats
+{
+	size_t nr_allocs;
+	size_t nr_frees;
+	size_t bytes;
+	size_t live_bytes;
+	size_t peak_bytes;
+};
+
+/* Allocations made by fs_x*alloc() at a single line of code. */
+struct fs_malloc_site
+{
+	const char *file;
+	int line;
+	size_t nr_allocs;
+	size_t bytes;
+};
+
+void fs_malloc_stats_enable(int enable);
+void fs_malloc_stats_reset(void);
+void fs_malloc_stats_get(struct fs_malloc_stats *stats);
+/* Call @cb for each call site that allocated memory since the last reset. */
+void fs_malloc_stats_foreach_site(void (*cb)(const struct fs_malloc_site *site, void *arg),
+				  void *arg);
+
+struct fs_arena_chunk;
+
+/*
+   A bump allocator. Blocks allocated from an arena cannot be freed
+   individually, instead all blocks allocated after a mark are released
+   at once by fs_arena_reset(), and all blocks by fs_arena_release().
+ */
+struct fs_arena
+{
+	struct fs_arena_chunk *chunk;
+	size_t used;
+	size_t chunk_size;
+
+	/* A chunk kept by fs_arena_reset() for reuse. */
+	struct fs_arena_chunk *spare;
+};
+
+struct fs_arena_mark
+{
+	struct fs_arena_chunk *chunk;
+	size_t used;
+};
+
+/* Initialise an empty arena that allocates memory in chunks of
+   @chunk_size bytes, or of a default size if @chunk_size is 0. */
+void fs_arena_init(struct fs_arena *a, size_t chunk_size);
+
+/* Allocate @size bytes aligned for any type, and panic if memory
+   allocation fails. Chunks are accounted to the call site that made
+   the arena grow. */
+#define fs_arena_alloc(a, size) fs_arena_alloc_at((a), (size), __FILE__, __LINE__)
+void* fs_arena_alloc_at(struct fs_arena *a, size_t size, const char *file, int line)
+	__attribute__((malloc));
+
+/* Same as fs_arena_alloc(), but returns zero-initialised memory. */
+#define fs_arena_zalloc(a, size) fs_arena_zalloc_at((a), (size), __FILE__, __LINE__)
+void* fs_arena_zalloc_at(struct fs_arena *a, size_t size, const char *file, int line)
+	__attribute__((malloc));
+
+/* Remember the current state of an arena. */
+struct fs_arena_mark fs_arena_mark(const struct fs_arena *a);
+
+/* Release all blocks allocated after @mark was taken. */
+void fs_arena_reset(struct fs_arena *a, struct fs_arena_mark mark);
+
+/* Release all blocks and the memory used by an arena. The arena
+   remains initialised and may be used again. */
+void fs_arena_release(struct fs_arena *a);
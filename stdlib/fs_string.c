@@ -4,9 +4,11 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+#include <errno.h>
 #include <err.h>
 
-char* fs_xasprintf(const char *fmt, ...)
+char* fs_xasprintf_at(const char *file, int line, const char *fmt, ...)
 {
 	va_list ap;
 	int n;
@@ -20,9 +22,9 @@ char* fs_xasprintf(const char *fmt, ...)
 		errx(1, "bad format string");
 
 	if ((size_t)n < sizeof(buf))
-		return fs_xstrdup(buf);
+		return fs_xstrdup_at(buf, file, line);
 
-	char *out = fs_xmalloc(n + 1);
+	char *out = fs_xmalloc_at(n + 1, file, line);
 	int m;
 	va_start(ap, fmt);
 	m = vsnprintf(out, n + 1, fmt, ap);
@@ -34,10 +36,157 @@ char* fs_xasprintf(const char *fmt, ...)
 	return out;
 }
 
-char* fs_xstrdup(const char *x)
+char* fs_xstrdup_at(const char *x, const char *file, int line)
 {
 	size_t len = strlen(x);
-	char *copy = fs_xmalloc(len + 1);
+	char *copy = fs_xmalloc_at(len + 1, file, line);
 	memcpy(copy, x, len + 1);
 	return copy;
 }
+
+void fs_strbuf_free(struct fs_strbuf *b)
+{
+	fs_xfree(b->s);
+	b->s = NULL;
+	b->len = b->cap = 0;
+}
+
+const char* fs_strbuf_str(const struct fs_strbuf *b)
+{
+	return b->s ? b->s : "";
+}
+
+void fs_strbuf_reserve_at(struct fs_strbuf *b, size_t len, const char *file, int line)
+{
+	if (len < b->cap)
+		return;
+
+	size_t cap = b->cap ? b->cap : 64;
+	while (cap <= len)
+		cap *= 2;
+
+	b->s = fs_xrealloc_at(b->s, cap, file, line);
+	b->cap = cap;
+	b->s[b->len] = '\0';
+}
+
+void fs_strbuf_truncate(struct fs_strbuf *b, size_t len)
+{
+	if (b->s == NULL)
+		return;
+	b->len = len;
+	b->s[len] = '\0';
+}
+
+void fs_strbuf_clear(struct fs_strbuf *b)
+{
+	fs_strbuf_truncate(b, 0);
+}
+
+void fs_strbuf_append_at(struct fs_strbuf *b, const char *s, size_t len, const char *file, int line)
+{
+	fs_strbuf_reserve_at(b, b->len + len, file, line);
+	memcpy(b->s + b->len, s, len);
+	b->len += len;
+	b->s[b->len] = '\0';
+}
+
+void fs_strbuf_appends_at(struct fs_strbuf *b, const char *s, const char *file, int line)
+{
+	fs_strbuf_append_at(b, s, strlen(s), file, line);
+}
+
+void fs_strbuf_appendc_at(struct fs_strbuf *b, char c, const char *file, int line)
+{
+	fs_strbuf_reserve_at(b, b->len + 1, file, line);
+	b->s[b->len++] = c;
+	b->s[b->len] = '\0';
+}
+
+void fs_strbuf_appendf_at(const char *file, int line, struct fs_strbuf *b, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	/* Format straight into the spare capacity, and only retry
+	   if it was too short. */
+	fs_strbuf_reserve_at(b, b->len, file, line);
+	size_t avail = b->cap - b->len;
+
+	va_start(ap, fmt);
+	n = vsnprintf(b->s + b->len, avail, fmt, ap);
+	va_end(ap);
+
+	if (n < 0)
+		errx(1, "bad format string");
+
+	if ((size_t)n >= avail) {
+		fs_strbuf_reserve_at(b, b->len + n, file, line);
+		va_start(ap, fmt);
+		vsnprintf(b->s + b->len, n + 1, fmt, ap);
+		va_end(ap);
+	}
+	b->len += n;
+}
+
+void fs_strbuf_append_uint_at(struct fs_strbuf *b, unsigned long long x, const char *file, int line)
+{
+	char digits[20];
+	size_t n = 0;
+
+	do {
+		digits[sizeof(digits) - ++n] = '0' + x % 10;
+		x /= 10;
+	} while (x);
+
+	fs_strbuf_append_at(b, digits + sizeof(digits) - n, n, file, line);
+}
+
+void fs_strbuf_append_int_at(struct fs_strbuf *b, long long x, const char *file, int line)
+{
+	if (x < 0) {
+		fs_strbuf_appendc_at(b, '-', file, line);
+		fs_strbuf_append_uint_at(b, -(unsigned long long)x, file, line);
+	} else {
+		fs_strbuf_append_uint_at(b, x, file, line);
+	}
+}
+
+size_t fs_strbuf_push_path_at(struct fs_strbuf *b, const char *name, const char *file, int line)
+{
+	size_t len = b->len;
+	if (len && b->s[len - 1] != '/')
+		fs_strbuf_appendc_at(b, '/', file, line);
+	fs_strbuf_appends_at(b, name, file, line);
+	return len;
+}
+
+void fs_strbuf_pop_path(struct fs_strbuf *b)
+{
+	size_t len = b->len;
+	while (len && b->s[len - 1] == '/')
+		--len;
+	while (len && b->s[len - 1] != '/')
+		--len;
+	fs_strbuf_truncate(b, len);
+}
+
+int fs_strbuf_readlinkat_at(struct fs_strbuf *b, int dirfd, const char *path,
+			    const char *file, int line)
+{
+	fs_strbuf_reserve_at(b, 64, file, line);
+
+	for (;;) {
+		ssize_t n = readlinkat(dirfd, path, b->s, b->cap);
+		if (n < 0) {
+			fs_strbuf_clear(b);
+			return -errno;
+		}
+		if ((size_t)n < b->cap) {
+			b->len = n;
+			b->s[n] = '\0';
+			return 0;
+		}
+		fs_strbuf_reserve_at(b, b->cap, file, line);
+	}
+}
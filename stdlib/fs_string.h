@@ -1,7 +1,88 @@
 #pragma once
 
+#include <stddef.h>
+
+/*
+   Functions that allocate memory are macros that pass their call site
+   down to fs_x*alloc_at(), so that allocation statistics are reported
+   against the caller rather than against this library. The _at()
+   variants are for wrappers that want to pass their own caller through.
+ */
+
 /* Print a message into a heap-allocated string, and panic if memory allocation fails. */
-char* fs_xasprintf(const char *fmt, ...) __attribute__((malloc, format(printf, 1, 2)));
+#define fs_xasprintf(...) fs_xasprintf_at(__FILE__, __LINE__, __VA_ARGS__)
+char* fs_xasprintf_at(const char *file, int line, const char *fmt, ...)
+	__attribute__((malloc, format(printf, 3, 4)));
 
 /* Duplicate a string, and panic if memory allocation fails. */
-char* fs_xstrdup(const char *x) __attribute__((malloc));
+#define fs_xstrdup(x) fs_xstrdup_at((x), __FILE__, __LINE__)
+char* fs_xstrdup_at(const char *x, const char *file, int line) __attribute__((malloc));
+
+/*
+   A growable NUL-terminated string. A zeroed fs_strbuf is an empty
+   string, and clearing or truncating it keeps the memory, so a single
+   buffer may be reused across iterations without reallocation.
+ */
+struct fs_strbuf
+{
+	char *s;
+	size_t len;
+	size_t cap;
+};
+
+#define FS_STRBUF_INIT {NULL, 0, 0}
+
+/* Free the memory of @b and make it empty. */
+void fs_strbuf_free(struct fs_strbuf *b);
+
+/* Return the content of @b, which is "" for an empty buffer. */
+const char* fs_strbuf_str(const struct fs_strbuf *b);
+
+/* Make room for a string of @len bytes (without the terminating NUL). */
+#define fs_strbuf_reserve(b, len) fs_strbuf_reserve_at((b), (len), __FILE__, __LINE__)
+void fs_strbuf_reserve_at(struct fs_strbuf *b, size_t len, const char *file, int line);
+
+/* Shorten @b to @len bytes. */
+void fs_strbuf_truncate(struct fs_strbuf *b, size_t len);
+void fs_strbuf_clear(struct fs_strbuf *b);
+
+#define fs_strbuf_append(b, s, len) fs_strbuf_append_at((b), (s), (len), __FILE__, __LINE__)
+void fs_strbuf_append_at(struct fs_strbuf *b, const char *s, size_t len, const char *file, int line);
+
+#define fs_strbuf_appends(b, s) fs_strbuf_appends_at((b), (s), __FILE__, __LINE__)
+void fs_strbuf_appends_at(struct fs_strbuf *b, const char *s, const char *file, int line);
+
+#define fs_strbuf_appendc(b, c) fs_strbuf_appendc_at((b), (c), __FILE__, __LINE__)
+void fs_strbuf_appendc_at(struct fs_strbuf *b, char c, const char *file, int line);
+
+#define fs_strbuf_appendf(b, ...) fs_strbuf_appendf_at(__FILE__, __LINE__, (b), __VA_ARGS__)
+void fs_strbuf_appendf_at(const char *file, int line, struct fs_strbuf *b, const char *fmt, ...)
+	__attribute__((format(printf, 4, 5)));
+
+/* Append a decimal number without going through printf(). */
+#define fs_strbuf_append_uint(b, x) fs_strbuf_append_uint_at((b), (x), __FILE__, __LINE__)
+void fs_strbuf_append_uint_at(struct fs_strbuf *b, unsigned long long x, const char *file, int line);
+
+#define fs_strbuf_append_int(b, x) fs_strbuf_append_int_at((b), (x), __FILE__, __LINE__)
+void fs_strbuf_append_int_at(struct fs_strbuf *b, long long x, const char *file, int line);
+
+/*
+   Append a path component @name, adding a '/' in front of it unless
+   @b is empty or already ends with '/'. Return the length of @b before
+   the push, which may be passed to fs_strbuf_truncate() to undo it.
+ */
+#define fs_strbuf_push_path(b, name) fs_strbuf_push_path_at((b), (name), __FILE__, __LINE__)
+size_t fs_strbuf_push_path_at(struct fs_strbuf *b, const char *name, const char *file, int line);
+
+/* Remove the last component of a path in @b, keeping the '/' before it. */
+void fs_strbuf_pop_path(struct fs_strbuf *b);
+
+/*
+   Replace the content of @b with the target of a symlink at @path,
+   relative to @dirfd as in readlinkat(). Return 0 if successful and
+   a (negative) errno code otherwise.
+ */
+#define fs_strbuf_readlinkat(b, dirfd, path) \
+	fs_strbuf_readlinkat_at((b), (dirfd), (path), __FILE__, __LINE__)
+int fs_strbuf_readlinkat_at(struct fs_strbuf *b, int dirfd, const char *path,
+			    const char *file, int line);